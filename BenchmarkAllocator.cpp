@@ -0,0 +1,68 @@
+// Counting allocator for the benchmark build
+// -------------------------------------------------------------------
+// Copyright (C) 2011 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+// Only linked into the CarVisualsBench target. Every allocation
+// through operator new in the process is counted, so the arena
+// benchmark reports what the allocator was actually asked for,
+// including the child lists AddNode() grows. Kept in its own
+// translation unit so the replacements are never inlined into callers.
+
+#include "Benchmarks.h"
+
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+static volatile unsigned long allocationCount = 0;
+
+#if __cplusplus >= 201103L
+#define NEW_THROWS
+#define DELETE_THROWS noexcept
+#else
+#define NEW_THROWS throw(std::bad_alloc)
+#define DELETE_THROWS throw()
+#endif
+
+void* operator new(size_t size) NEW_THROWS {
+#ifdef _WIN32
+    InterlockedIncrement((volatile LONG*)&allocationCount);
+#else
+    __atomic_fetch_add(&allocationCount, 1, __ATOMIC_RELAXED);
+#endif
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size) NEW_THROWS {
+    return operator new(size);
+}
+
+void operator delete(void* p) DELETE_THROWS {
+    free(p);
+}
+
+void operator delete[](void* p) DELETE_THROWS {
+    free(p);
+}
+
+namespace Benchmarks {
+
+    unsigned long GetAllocationCount() {
+#ifdef _WIN32
+        return InterlockedCompareExchange((volatile LONG*)&allocationCount, 0, 0);
+#else
+        return __atomic_load_n(&allocationCount, __ATOMIC_RELAXED);
+#endif
+    }
+
+}
@@ -0,0 +1,407 @@
+// Benchmarks
+// -------------------------------------------------------------------
+// Copyright (C) 2011 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include "Benchmarks.h"
+
+#include <Core/Mutex.h>
+#include <Core/Thread.h>
+#include <Logging/Logger.h>
+#include <Scene/SceneNode.h>
+#include <Scene/TransformationNode.h>
+#include <Scene/MeshNode.h>
+#include <Utils/MeshCreator.h>
+#include <Utils/Timer.h>
+#include "Logging/AsyncLogger.h"
+#include "Renderers/LightClusters.h"
+#include "Scene/SceneArena.h"
+#include "Utils/HUDSurface.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#else
+#include <windows.h>
+#endif
+
+using namespace OpenEngine::Core;
+using namespace OpenEngine::Geometry;
+using namespace OpenEngine::Logging;
+using namespace OpenEngine::Math;
+using namespace OpenEngine::Renderers;
+using namespace OpenEngine::Scene;
+using namespace OpenEngine::Utils;
+using namespace std;
+
+namespace Benchmarks {
+
+    class LogThread : public Thread {
+    private:
+        AsyncLogger* line;
+        Mutex* lock;
+        unsigned int calls;
+    public:
+        unsigned long long total;
+        unsigned int max;
+        // with a lock the thread logs through the shared global
+        // streams, otherwise through a LogLine to the given logger
+        LogThread(AsyncLogger* line, Mutex* lock, unsigned int calls)
+            : line(line), lock(lock), calls(calls), total(0), max(0) {}
+
+        void Run() {
+            const string name = "CarPaint";
+            Timer timer;
+            timer.Start();
+            for (unsigned int i = 0; i < calls; ++i) {
+                timer.Reset();
+                if (lock) {
+                    lock->Lock();
+                    logger.info << "Material: " << name << ", node " << i
+                                << ", addr " << (const void*)this << logger.end;
+                    lock->Unlock();
+                }
+                else
+                    LogLine(*line, Info) << "Material: " << name << ", node " << i
+                                         << ", addr " << (const void*)this;
+                unsigned int t = timer.GetElapsedIntervals(1);
+                total += t;
+                if (t > max) max = t;
+            }
+        }
+    };
+
+    static void LogContention(AsyncLogger* line, Mutex* lock, unsigned int threads,
+                              unsigned int calls, double& avg, unsigned int& max) {
+        vector<LogThread*> workers;
+        for (unsigned int i = 0; i < threads; ++i)
+            workers.push_back(new LogThread(line, lock, calls));
+        for (unsigned int i = 0; i < threads; ++i)
+            workers[i]->Start();
+
+        unsigned long long total = 0;
+        max = 0;
+        for (unsigned int i = 0; i < threads; ++i) {
+            workers[i]->Wait();
+            total += workers[i]->total;
+            if (workers[i]->max > max) max = workers[i]->max;
+            delete workers[i];
+        }
+        avg = double(total) / (threads * calls);
+    }
+
+    // Size of the synthetic asset, roughly a car model.
+    static const unsigned int ASSET_PARTS = 200;
+    static const unsigned int ASSET_MESHES = 10;
+
+    static ISceneNode* BuildHeapAsset(MeshPtr proto) {
+        ISceneNode* root = new SceneNode();
+        for (unsigned int i = 0; i < ASSET_PARTS; ++i) {
+            TransformationNode* part = new TransformationNode();
+            part->Move(i, 0, 0);
+            root->AddNode(part);
+            for (unsigned int j = 0; j < ASSET_MESHES; ++j) {
+                Mesh* mesh = new Mesh(proto->GetIndices(), proto->GetType(),
+                                      proto->GetGeometrySet(), proto->GetMaterial(),
+                                      proto->GetIndexOffset(), proto->GetDrawingRange());
+                part->AddNode(new MeshNode(MeshPtr(mesh)));
+            }
+        }
+        return root;
+    }
+
+    static void DeleteHeapAsset(ISceneNode* node) {
+        while (node->GetNumberOfNodes() > 0) {
+            ISceneNode* child = node->GetNode(0);
+            node->RemoveNode(child);
+            DeleteHeapAsset(child);
+        }
+        delete node;
+    }
+
+    static long PeakRSS() {
+#ifndef _WIN32
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+#else
+        return 0;
+#endif
+    }
+
+    // Zero unless built as CarVisualsBench.
+    static unsigned long AllocationCount() {
+#ifdef COUNT_ALLOCATIONS
+        return GetAllocationCount();
+#else
+        return 0;
+#endif
+    }
+
+    struct ChurnResult {
+        unsigned int load, unload;
+        unsigned long allocations;
+        long rss;
+        bool ok;
+    };
+
+    // The -arena path of main: load onto the heap, copy into an arena
+    // and delete the original, later unload with one Release().
+    static void Churn(bool useArena, MeshPtr proto, unsigned int iterations,
+                      ChurnResult& result) {
+        long rss = PeakRSS();
+        unsigned long allocations = AllocationCount();
+        result.load = result.unload = 0;
+        result.ok = true;
+        Timer timer;
+        timer.Start();
+        for (unsigned int i = 0; i < iterations && result.ok; ++i) {
+            timer.Reset();
+            ISceneNode* asset = BuildHeapAsset(proto);
+            SceneArena* arena = NULL;
+            if (useArena) {
+                arena = new SceneArena();
+                ISceneNode* copy = arena->Clone(asset);
+                DeleteHeapAsset(asset);
+                asset = copy;
+                result.ok = copy != NULL;
+            }
+            result.load += timer.GetElapsedIntervals(1);
+
+            timer.Reset();
+            if (arena) {
+                result.ok = arena->Release() && result.ok;
+                delete arena;
+            }
+            else DeleteHeapAsset(asset);
+            result.unload += timer.GetElapsedIntervals(1);
+        }
+        result.allocations = AllocationCount() - allocations;
+        result.rss = PeakRSS() - rss;
+    }
+
+    // Run each variant in a child process, the peak RSS of a process
+    // only ever grows and would hide whichever variant runs second.
+    static bool ChurnProcess(bool useArena, MeshPtr proto, unsigned int iterations,
+                             ChurnResult& result) {
+#ifndef _WIN32
+        int fds[2];
+        if (pipe(fds) != 0) return false;
+        pid_t pid = fork();
+        if (pid < 0) {
+            close(fds[0]);
+            close(fds[1]);
+            return false;
+        }
+        if (pid == 0) {
+            close(fds[0]);
+            Churn(useArena, proto, iterations, result);
+            ssize_t written = write(fds[1], &result, sizeof(result));
+            _exit(written == sizeof(result) ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+        close(fds[1]);
+        bool ok = read(fds[0], &result, sizeof(result)) == sizeof(result);
+        close(fds[0]);
+        waitpid(pid, NULL, 0);
+        return ok;
+#else
+        Churn(useArena, proto, iterations, result);
+        return true;
+#endif
+    }
+
+    int Run(const string name, ILogger* log) {
+        // the log benchmark adds the logger once it is done measuring
+        if (name == "log") return Log(4, 20000, log);
+        Logger::AddLogger(log);
+        if (name == "hud") return HUD(100000);
+        if (name == "arena") return Arena(200);
+        if (name == "lights") return Lights(256, 200);
+        logger.error << "Unknown benchmark: " << name << logger.end;
+        return EXIT_FAILURE;
+    }
+
+    int HUD(unsigned int frames) {
+        HUDSurfacePtr hud = HUDSurface::Create();
+        unsigned int render = hud->AddPhase("render");
+        unsigned int update = hud->AddPhase("update");
+
+        unsigned long long updateTime = 0, dirtyPixels = 0;
+        unsigned int maxUpdate = 0;
+        Timer timer;
+        timer.Start();
+        for (unsigned int i = 0; i < frames; ++i) {
+            hud->Mark(render);
+            hud->Mark(update);
+            // synthetic 14-19 ms frames
+            hud->Update(14000 + (i * 7919) % 5000);
+            updateTime += hud->GetLastUpdateTime();
+            dirtyPixels += hud->GetLastDirtyPixels();
+            if (hud->GetLastUpdateTime() > maxUpdate)
+                maxUpdate = hud->GetLastUpdateTime();
+        }
+        unsigned int total = timer.GetElapsedIntervals(1);
+
+        logger.info << "HUD: " << frames << " frames in " << total / 1000 << " ms" << logger.end;
+        logger.info << "HUD: update avg " << double(updateTime) / frames
+                    << " us, max " << maxUpdate << " us" << logger.end;
+        logger.info << "HUD: uploaded " << double(dirtyPixels) / frames
+                    << " texels/frame of " << HUDSurface::WIDTH * HUDSurface::HEIGHT
+                    << logger.end;
+        return EXIT_SUCCESS;
+    }
+
+    int Log(unsigned int threads, unsigned int calls, ILogger* log) {
+        // the measured messages go to a file, the sink stays registered
+        // until exit as Logger keeps no way to remove it
+        const char* file = "log-bench.txt";
+        AsyncLogger* sink = new AsyncLogger(new ofstream(file));
+        Logger::AddLogger(sink);
+
+        double globalAvg, lineAvg;
+        unsigned int globalMax, lineMax;
+        Mutex lock;
+        unsigned int dropped = sink->GetDropped();
+        LogContention(sink, &lock, threads, calls, globalAvg, globalMax);
+        unsigned int globalDropped = sink->GetDropped() - dropped;
+        dropped = sink->GetDropped();
+        LogContention(sink, NULL, threads, calls, lineAvg, lineMax);
+        unsigned int lineDropped = sink->GetDropped() - dropped;
+        const double messages = threads * calls / 100.0;
+
+        Logger::AddLogger(log);
+        logger.info << "Log: " << threads << " threads, " << calls
+                    << " calls each, messages written to " << file << logger.end;
+        logger.info << "Log: logger.info, locked: avg " << globalAvg
+                    << " us, max " << globalMax << " us per call, "
+                    << globalDropped / messages << "% dropped" << logger.end;
+        logger.info << "Log: LogLine:             avg " << lineAvg
+                    << " us, max " << lineMax << " us per call, "
+                    << lineDropped / messages << "% dropped" << logger.end;
+        return EXIT_SUCCESS;
+    }
+
+    int Arena(unsigned int iterations) {
+        MeshPtr proto = MeshCreator::CreateCube(1, 1, Vector<3,float>(1,1,1));
+
+        ChurnResult heap, arena;
+        if (!ChurnProcess(false, proto, iterations, heap) ||
+            !ChurnProcess(true, proto, iterations, arena) || !heap.ok || !arena.ok) {
+            logger.error << "Arena: could not run the benchmark process" << logger.end;
+            return EXIT_FAILURE;
+        }
+
+        logger.info << "Arena: " << iterations << " load/unload cycles of "
+                    << ASSET_PARTS * (ASSET_MESHES + 1) + 1 << " nodes" << logger.end;
+#ifndef COUNT_ALLOCATIONS
+        logger.info << "Arena: allocations are only counted by CarVisualsBench" << logger.end;
+#endif
+        logger.info << "Arena: heap  load " << heap.load / 1000 << " ms, unload "
+                    << heap.unload / 1000 << " ms, "
+                    << heap.allocations / iterations << " allocations/cycle, peak RSS +"
+                    << heap.rss << " kB" << logger.end;
+        logger.info << "Arena: arena load " << arena.load / 1000 << " ms, unload "
+                    << arena.unload / 1000 << " ms, "
+                    << arena.allocations / iterations << " allocations/cycle, peak RSS +"
+                    << arena.rss << " kB" << logger.end;
+        // the copy is paid on every load, any gain is on unload only
+        logger.info << "Arena: arena - heap: load "
+                    << (int(arena.load) - int(heap.load)) / 1000 << " ms, unload "
+                    << (int(arena.unload) - int(heap.unload)) / 1000 << " ms" << logger.end;
+        return EXIT_SUCCESS;
+    }
+
+    int Lights(unsigned int count, unsigned int iterations) {
+        // a showroom around the car, viewed from CamHandler's default orbit
+        LightClusters clusters;
+        srand(42);
+        for (unsigned int i = 0; i < count; ++i) {
+            LightClusters::Light light;
+            light.position[0] = (rand() % 2000) / 10.0f - 100.0f;
+            light.position[1] = (rand() % 400) / 10.0f;
+            light.position[2] = (rand() % 2000) / 10.0f - 100.0f;
+            light.color[0] = light.color[1] = light.color[2] = 1.0f;
+            light.constAtt = 1.0f;
+            light.linearAtt = 0.0f;
+            light.quadAtt = (1 + rand() % 50) / 10.0f;
+            light.radius = 0.0f;
+            clusters.AddLight(light);
+        }
+        ViewBasis basis(Vector<3,float>(0.0f, 6.2f, 19.0f), Vector<3,float>(0.0f));
+        const float fovy = 0.7853982f, aspect = 4.0f / 3.0f, znear = 1.0f, zfar = 1000.0f;
+        clusters.SetView(basis, fovy, aspect, znear, zfar);
+
+        Timer timer;
+        const unsigned int threadCounts[] = { 1, 4 };
+        for (unsigned int t = 0; t < 2; ++t) {
+            timer.Start();
+            for (unsigned int i = 0; i < iterations; ++i)
+                clusters.Build(threadCounts[t]);
+            unsigned int elapsed = timer.GetElapsedIntervals(1);
+            logger.info << "Lights: " << count << " lights, " << clusters.GetClusterCount()
+                        << " clusters, " << threadCounts[t] << " threads: "
+                        << double(elapsed) / iterations << " us/build, "
+                        << clusters.GetIndices().size() << " entries" << logger.end;
+        }
+
+        // every cluster list must equal the brute force overlap set
+        unsigned int mismatches = 0, bruteTime;
+        timer.Reset();
+        for (unsigned int c = 0; c < clusters.GetClusterCount(); ++c) {
+            vector<unsigned int> expected;
+            for (unsigned int l = 0; l < clusters.GetLightCount(); ++l)
+                if (clusters.Overlaps(c, l)) expected.push_back(l);
+            unsigned int n;
+            const unsigned int* ids = clusters.GetClusterLights(c, n);
+            if (n != expected.size() || (n && !equal(expected.begin(), expected.end(), ids)))
+                ++mismatches;
+        }
+        bruteTime = timer.GetElapsedIntervals(1);
+        logger.info << "Lights: brute force " << bruteTime << " us, "
+                    << mismatches << " mismatching clusters" << logger.end;
+
+        // a point's list must hold every light reaching it; the points
+        // are drawn inside the frustum, exponentially in depth like the
+        // slices, so every lookup lands in a cluster
+        unsigned int outside = 0, missed = 0, reached = 0;
+        const unsigned int samples = 20000;
+        const float ky = tan(fovy * 0.5f), kx = ky * aspect;
+        for (unsigned int i = 0; i < samples; ++i) {
+            float z = znear * exp(log(zfar / znear) * (0.5f + rand() % 10000) / 10001.0f);
+            float x = ((rand() % 1999) / 1000.0f - 0.999f) * z * kx;
+            float y = ((rand() % 1999) / 1000.0f - 0.999f) * z * ky;
+            Vector<3,float> p = basis.eye + basis.right * x + basis.up * y + basis.forward * z;
+            unsigned int cluster = clusters.GetCluster(clusters.ToView(p));
+            if (cluster == LightClusters::NO_CLUSTER) {
+                ++outside;
+                continue;
+            }
+            unsigned int n;
+            const unsigned int* ids = clusters.GetClusterLights(cluster, n);
+            for (unsigned int l = 0; l < clusters.GetLightCount(); ++l) {
+                const LightClusters::Light& light = clusters.GetLight(l);
+                if ((light.position - p).GetLength() > light.radius) continue;
+                ++reached;
+                if (find(ids, ids + n, l) == ids + n) ++missed;
+            }
+        }
+        logger.info << "Lights: " << samples << " lookups inside the frustum, " << outside
+                    << " outside the grid, " << reached << " lights reaching them, "
+                    << missed << " missed" << logger.end;
+        if (outside > 0) return EXIT_FAILURE;
+        return mismatches == 0 && missed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+}
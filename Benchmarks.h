@@ -0,0 +1,58 @@
+// Benchmarks
+// -------------------------------------------------------------------
+// Copyright (C) 2011 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _CAR_VISUALS_BENCHMARKS_H_
+#define _CAR_VISUALS_BENCHMARKS_H_
+
+#include <string>
+
+namespace OpenEngine {
+    namespace Logging {
+        class ILogger;
+    }
+}
+
+/**
+ * Headless benchmarks, run with "CarVisuals -bench <name>". None of
+ * them open a window or touch the GL context.
+ */
+namespace Benchmarks {
+
+    /**
+     * Run the named benchmark and return the process exit code. The
+     * results are written through log, which is added to the global
+     * Logger.
+     */
+    int Run(const std::string name, OpenEngine::Logging::ILogger* log);
+
+    // CPU cost per frame of the HUD overlay.
+    int HUD(unsigned int frames);
+
+    // Latency of a formatted log call with several threads logging at
+    // once, through the global logger streams and through LogLine.
+    int Log(unsigned int threads, unsigned int calls,
+            OpenEngine::Logging::ILogger* log);
+
+    // Load and unload a synthetic asset on the heap and through an
+    // arena copy as with -arena, each in a child process, timing load
+    // and unload apart. The CarVisualsBench build also counts every
+    // operator new.
+    int Arena(unsigned int iterations);
+
+#ifdef COUNT_ALLOCATIONS
+    // operator new calls so far, from BenchmarkAllocator.cpp
+    unsigned long GetAllocationCount();
+#endif
+
+    // Cluster binning time, checked against brute force overlap.
+    int Lights(unsigned int lights, unsigned int iterations);
+
+}
+
+#endif // _CAR_VISUALS_BENCHMARKS_H_
@@ -13,6 +13,7 @@
 #include <Logging/Logger.h>
 #include <Scene/ISceneNode.h>
 #include <Scene/MeshNode.h>
+#include "../Scene/SceneArena.h"
 
 using namespace OpenEngine::Scene;
 using namespace std;
@@ -20,8 +21,8 @@ using namespace std;
 namespace OpenEngine {
 namespace Geometry {
 
-    MaterialReplacer::Replacer::Replacer(ISceneNode* scene, const string oldMat, const MaterialPtr newMat)
-        : oldMat(oldMat), newMat(newMat) {
+    MaterialReplacer::Replacer::Replacer(ISceneNode* scene, const string oldMat, const MaterialPtr newMat, SceneArena* arena)
+        : oldMat(oldMat), newMat(newMat), arena(arena) {
         scene->Accept(*this);
     }
 
@@ -31,14 +32,18 @@ namespace Geometry {
         if (mat->GetName().compare(oldMat) == 0) {
             logger.info << "Mat should be replaced" << logger.end;
             MeshPtr om = node->GetMesh();
-            Mesh* newMesh = new Mesh(om->GetIndices(), om->GetType(), om->GetGeometrySet(), newMat, om->GetIndexOffset(), om->GetDrawingRange());
-            node->SetMesh(MeshPtr(newMesh));
+            if (arena)
+                node->SetMesh(arena->CreateMesh(om, newMat));
+            else {
+                Mesh* newMesh = new Mesh(om->GetIndices(), om->GetType(), om->GetGeometrySet(), newMat, om->GetIndexOffset(), om->GetDrawingRange());
+                node->SetMesh(MeshPtr(newMesh));
+            }
         }
         node->VisitSubNodes(*this);
     }
 
-    void MaterialReplacer::InScene(ISceneNode* scene, const string oldMat, const MaterialPtr newMat){
-        Replacer(scene, oldMat, newMat);
+    void MaterialReplacer::InScene(ISceneNode* scene, const string oldMat, const MaterialPtr newMat, SceneArena* arena){
+        Replacer(scene, oldMat, newMat, arena);
     }
 
 }
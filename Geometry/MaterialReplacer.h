@@ -17,6 +17,7 @@ namespace OpenEngine {
     namespace Scene {
         class ISceneNode;
         class MeshNode;
+        class SceneArena;
     }
 namespace Geometry {
 
@@ -25,13 +26,18 @@ namespace Geometry {
         class Replacer : public virtual Scene::ISceneNodeVisitor {
             const std::string oldMat;
             const MaterialPtr newMat;
+            Scene::SceneArena* arena;
         public:
-            Replacer(Scene::ISceneNode* scene, const std::string oldMat, const MaterialPtr newMat);
+            Replacer(Scene::ISceneNode* scene, const std::string oldMat, const MaterialPtr newMat, Scene::SceneArena* arena);
             void VisitMeshNode(Scene::MeshNode* node);
         };
 
     public:
-        static void InScene(Scene::ISceneNode* scene, const std::string oldMat, const MaterialPtr newMat);
+        /**
+         * Replace oldMat with newMat on every mesh in the scene. The
+         * new meshes are placed in the arena when one is given.
+         */
+        static void InScene(Scene::ISceneNode* scene, const std::string oldMat, const MaterialPtr newMat, Scene::SceneArena* arena = NULL);
         
     };
 
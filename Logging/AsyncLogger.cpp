@@ -0,0 +1,235 @@
+// Asynchronous logger
+// -------------------------------------------------------------------
+// Copyright (C) 2011 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include "AsyncLogger.h"
+#include "../Utils/Atomic.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+
+namespace OpenEngine {
+namespace Logging {
+
+using namespace Utils;
+using namespace std;
+
+// Consumer sleep in microseconds while the ring stays empty.
+static const unsigned int MIN_BACKOFF = 50;
+static const unsigned int MAX_BACKOFF = 1000;
+
+// Live loggers, drained by the atexit handler.
+static Core::Mutex registryLock;
+static list<AsyncLogger*> registry;
+static bool atexitRegistered = false;
+
+AsyncLogger::AsyncLogger(ostream* stream, bool color, unsigned int capacity)
+    : stream(stream), color(color), head(0), tail(0), dropped(0), reported(0), running(1), writers(0) {
+    unsigned int size = 2;
+    while (size < capacity) size <<= 1;
+    mask = size - 1;
+    slots = new Slot[size];
+    for (unsigned int i = 0; i < size; ++i)
+        slots[i].seq = i;
+
+    registryLock.Lock();
+    registry.push_back(this);
+    if (!atexitRegistered) {
+        atexit(&AsyncLogger::FlushAll);
+        atexitRegistered = true;
+    }
+    registryLock.Unlock();
+
+    Start();
+}
+
+AsyncLogger::~AsyncLogger() {
+    registryLock.Lock();
+    registry.remove(this);
+    registryLock.Unlock();
+    Stop();
+    delete[] slots;
+}
+
+void AsyncLogger::Write(LoggerType type, string msg) {
+    Write(type, msg.data(), msg.size());
+}
+
+void AsyncLogger::Write(LoggerType type, const char* text, unsigned int length) {
+    if (length > SLOT_SIZE) length = SLOT_SIZE;
+
+    // announce the write before checking running, Stop() waits for it
+    AtomicAdd(&writers, 1);
+    if (!AtomicLoadSeq(&running)) {
+        AtomicAdd(&writers, -1);
+        Slot slot;
+        slot.type = type;
+        slot.length = length;
+        memcpy(slot.text, text, length);
+        // stopped, write on this thread after anything still queued
+        streamLock.Lock();
+        DrainLocked();
+        Output(slot);
+        stream->flush();
+        streamLock.Unlock();
+        return;
+    }
+
+    Slot* slot;
+    unsigned int pos = AtomicLoad(&head);
+    for (;;) {
+        slot = &slots[pos & mask];
+        int diff = int(AtomicLoad(&slot->seq) - pos);
+        if (diff == 0) {
+            if (AtomicCAS(&head, pos, pos + 1)) break;
+        }
+        else if (diff < 0) {
+            // full, drop the oldest message to make room
+            Slot oldest;
+            if (Pop(oldest)) AtomicIncrement(&dropped);
+        }
+        pos = AtomicLoad(&head);
+    }
+
+    slot->type = type;
+    slot->length = length;
+    memcpy(slot->text, text, length);
+    AtomicStore(&slot->seq, pos + 1);
+    AtomicAdd(&writers, -1);
+}
+
+bool AsyncLogger::Pop(Slot& out) {
+    Slot* slot;
+    unsigned int pos = AtomicLoad(&tail);
+    for (;;) {
+        slot = &slots[pos & mask];
+        int diff = int(AtomicLoad(&slot->seq) - (pos + 1));
+        if (diff == 0) {
+            if (AtomicCAS(&tail, pos, pos + 1)) break;
+        }
+        else if (diff < 0) return false; // empty
+        pos = AtomicLoad(&tail);
+    }
+
+    out.type = slot->type;
+    out.length = slot->length;
+    memcpy(out.text, slot->text, slot->length);
+    AtomicStore(&slot->seq, pos + mask + 1);
+    return true;
+}
+
+void AsyncLogger::Output(const Slot& slot) {
+    const char* tag;
+    const char* code;
+    switch (slot.type) {
+    case Error:   tag = "Error";   code = "\033[1;31m"; break;
+    case Warning: tag = "Warning"; code = "\033[1;33m"; break;
+    case Info:    tag = "Info";    code = "\033[1;32m"; break;
+    default:      tag = "Log";     code = "\033[1;34m"; break;
+    }
+    if (color) *stream << code << tag << ":\033[0m ";
+    else *stream << tag << ": ";
+    stream->write(slot.text, slot.length);
+    *stream << '\n';
+}
+
+bool AsyncLogger::Drain() {
+    streamLock.Lock();
+    bool wrote = DrainLocked();
+    streamLock.Unlock();
+    return wrote;
+}
+
+bool AsyncLogger::DrainLocked() {
+    Slot slot;
+    bool wrote = false;
+    while (Pop(slot)) {
+        Output(slot);
+        wrote = true;
+    }
+    unsigned int d = AtomicLoad(&dropped);
+    if (d != reported) {
+        *stream << "Warning: " << d - reported << " log messages dropped\n";
+        reported = d;
+        wrote = true;
+    }
+    if (wrote) stream->flush();
+    return wrote;
+}
+
+void AsyncLogger::Run() {
+    // keep draining while messages arrive, so only a real overload
+    // fills the ring; back off from 50 us to 1 ms while it is empty
+    unsigned int backoff = MIN_BACKOFF;
+    while (AtomicLoad(&running)) {
+        if (Drain()) {
+            backoff = MIN_BACKOFF;
+            continue;
+        }
+        Core::Thread::Sleep(backoff);
+        if (backoff < MAX_BACKOFF) backoff *= 2;
+    }
+}
+
+void AsyncLogger::Stop() {
+    if (!AtomicCAS(&running, 1, 0)) return;
+    Wait();
+    // writers that saw running before the CAS may still be filling slots
+    while (AtomicLoadSeq(&writers) > 0)
+        Core::Thread::Sleep(100);
+    Drain();
+}
+
+void AsyncLogger::FlushAll() {
+    registryLock.Lock();
+    for (list<AsyncLogger*>::iterator it = registry.begin(); it != registry.end(); ++it)
+        (*it)->Stop();
+    registryLock.Unlock();
+}
+
+void LogLine::Append(const char* s, unsigned int n) {
+    if (n > AsyncLogger::SLOT_SIZE - length)
+        n = AsyncLogger::SLOT_SIZE - length;
+    memcpy(text + length, s, n);
+    length += n;
+}
+
+template <class T>
+LogLine& LogLine::Format(const char* format, T value) {
+    char buf[32];
+    int n = snprintf(buf, sizeof(buf), format, value);
+    if (n > 0) Append(buf, n < int(sizeof(buf)) ? n : sizeof(buf) - 1);
+    return *this;
+}
+
+LogLine& LogLine::operator<<(const char* s) {
+    Append(s, strlen(s));
+    return *this;
+}
+
+LogLine& LogLine::operator<<(const string& s) {
+    Append(s.data(), s.size());
+    return *this;
+}
+
+LogLine& LogLine::operator<<(char c) {
+    Append(&c, 1);
+    return *this;
+}
+
+LogLine& LogLine::operator<<(int v) { return Format("%d", v); }
+LogLine& LogLine::operator<<(unsigned int v) { return Format("%u", v); }
+LogLine& LogLine::operator<<(long v) { return Format("%ld", v); }
+LogLine& LogLine::operator<<(unsigned long v) { return Format("%lu", v); }
+LogLine& LogLine::operator<<(double v) { return Format("%g", v); }
+LogLine& LogLine::operator<<(const void* p) { return Format("%p", p); }
+
+}
+}
@@ -0,0 +1,138 @@
+// Asynchronous logger
+// -------------------------------------------------------------------
+// Copyright (C) 2011 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _ASYNC_LOGGER_H_
+#define _ASYNC_LOGGER_H_
+
+#include <Logging/ILogger.h>
+#include <Core/Mutex.h>
+#include <Core/Thread.h>
+
+#include <ostream>
+#include <string>
+
+namespace OpenEngine {
+namespace Logging {
+
+/**
+ * Logger that never writes on the calling thread.
+ *
+ * Write() copies the message into a slot of a bounded lock free
+ * multi producer ring and returns. A background thread drains the
+ * ring to the stream. When the ring is full the oldest message is
+ * dropped and counted, so a burst of logging never blocks the render
+ * thread.
+ *
+ * All AsyncLoggers are drained when the logger is destroyed and from
+ * an atexit handler, so messages logged right before exit() are not
+ * lost. Stop() waits for writes in flight on other threads before the
+ * final drain.
+ *
+ * The global logger.info streams format every message in one shared
+ * buffer before it reaches Write(), so they are only safe on the main
+ * thread. Other threads should format with LogLine.
+ */
+class AsyncLogger : public ILogger, public Core::Thread {
+public:
+    static const unsigned int SLOT_SIZE = 240;
+
+private:
+    struct Slot {
+        volatile unsigned int seq;
+        LoggerType type;
+        unsigned int length;
+        char text[SLOT_SIZE];
+    };
+
+    std::ostream* stream;
+    bool color;
+    Slot* slots;
+    unsigned int mask;
+    volatile unsigned int head, tail;
+    volatile unsigned int dropped;
+    unsigned int reported;
+    volatile unsigned int running;
+    volatile unsigned int writers;
+    Core::Mutex streamLock;
+
+    bool Pop(Slot& out);
+    void Output(const Slot& slot);
+    // Both return whether any message was written.
+    bool Drain();
+    bool DrainLocked();
+
+public:
+    /**
+     * capacity is rounded up to a power of two.
+     */
+    AsyncLogger(std::ostream* stream, bool color = false, unsigned int capacity = 1024);
+    virtual ~AsyncLogger();
+
+    void Write(LoggerType type, std::string msg);
+    void Write(LoggerType type, const char* text, unsigned int length);
+
+    /**
+     * Stop the flush thread and write everything still in the ring.
+     * Logging after Stop() is written synchronously.
+     */
+    void Stop();
+
+    // Total number of messages dropped because the ring was full.
+    unsigned int GetDropped() const { return dropped; }
+
+    void Run();
+
+    /**
+     * Stop and drain every live AsyncLogger. Registered with atexit.
+     */
+    static void FlushAll();
+};
+
+/**
+ * Formats one message in a buffer on the calling thread's stack and
+ * writes it to an AsyncLogger when the line goes out of scope:
+ *
+ *   LogLine(log, Warning) << "could not write " << path;
+ *
+ * Nothing is shared until the finished message is queued, so any
+ * number of threads can log at once. Messages are truncated at
+ * AsyncLogger::SLOT_SIZE.
+ */
+class LogLine {
+private:
+    AsyncLogger& log;
+    LoggerType type;
+    char text[AsyncLogger::SLOT_SIZE];
+    unsigned int length;
+
+    void Append(const char* s, unsigned int n);
+    template <class T> LogLine& Format(const char* format, T value);
+
+    LogLine(const LogLine&);
+    LogLine& operator=(const LogLine&);
+
+public:
+    LogLine(AsyncLogger& log, LoggerType type) : log(log), type(type), length(0) {}
+    ~LogLine() { log.Write(type, text, length); }
+
+    LogLine& operator<<(const char* s);
+    LogLine& operator<<(const std::string& s);
+    LogLine& operator<<(char c);
+    LogLine& operator<<(int v);
+    LogLine& operator<<(unsigned int v);
+    LogLine& operator<<(long v);
+    LogLine& operator<<(unsigned long v);
+    LogLine& operator<<(double v);
+    LogLine& operator<<(const void* p);
+};
+
+}
+}
+
+#endif // _ASYNC_LOGGER_H_
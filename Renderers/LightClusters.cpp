@@ -0,0 +1,337 @@
+// Clustered light culling
+// -------------------------------------------------------------------
+// Copyright (C) 2011 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include "LightClusters.h"
+
+#include "../Utils/Atomic.h"
+
+#include <Core/Thread.h>
+#include <Math/Quaternion.h>
+#include <Scene/ISceneNode.h>
+#include <Scene/PointLightNode.h>
+
+#include <cmath>
+
+namespace OpenEngine {
+namespace Renderers {
+
+using namespace Math;
+using namespace Scene;
+using namespace Utils;
+using namespace std;
+
+// Radius used for lights that never fall off.
+static const float UNBOUNDED = 1e30f;
+
+// Idle workers poll for the next build, briefly yielding so a burst
+// of builds keeps them awake, then sleeping.
+static const unsigned int SPIN_POLLS = 1000;
+static const unsigned int IDLE_SLEEP = 1000;
+
+class LightClusters::Worker : public Core::Thread {
+private:
+    LightClusters& clusters;
+    Scratch scratch;
+public:
+    Worker(LightClusters& clusters) : clusters(clusters) {}
+    virtual ~Worker() {}
+
+    void Run() {
+        unsigned int seen = AtomicLoad(&clusters.generation), idle = 0;
+        while (!AtomicLoad(&clusters.stopping)) {
+            unsigned int g = AtomicLoad(&clusters.generation);
+            if (g != seen) {
+                seen = g;
+                idle = 0;
+                clusters.BuildSlices(scratch);
+            }
+            else if (++idle < SPIN_POLLS)
+                Core::Thread::Sleep(0);
+            else
+                Core::Thread::Sleep(IDLE_SLEEP);
+        }
+    }
+};
+
+LightClusters::LightClusters(unsigned int tilesX, unsigned int tilesY, unsigned int slices)
+    : tilesX(tilesX), tilesY(tilesY), slices(slices)
+    , sliceNear(slices), sliceFar(slices)
+    , tileXLo(slices * tilesX), tileXHi(slices * tilesX)
+    , tileYLo(slices * tilesY), tileYHi(slices * tilesY)
+    , offsets(tilesX * tilesY * slices + 1, 0)
+    , sliceIndices(slices)
+    , generation(0), nextSlice(0), doneSlices(0), stopping(0) {
+    SetView(ViewBasis(), 0.7853982f, 4.0f / 3.0f, 1.0f, 1000.0f);
+}
+
+LightClusters::~LightClusters() {
+    StopWorkers();
+}
+
+void LightClusters::StartWorkers(unsigned int count) {
+    for (unsigned int i = 0; i < count; ++i) {
+        workers.push_back(new Worker(*this));
+        workers.back()->Start();
+    }
+}
+
+void LightClusters::StopWorkers() {
+    AtomicStore(&stopping, 1);
+    for (unsigned int i = 0; i < workers.size(); ++i) {
+        workers[i]->Wait();
+        delete workers[i];
+    }
+    workers.clear();
+    AtomicStore(&stopping, 0);
+}
+
+float LightClusters::AttenuationRadius(float constAtt, float linearAtt, float quadAtt,
+                                       float intensity, float cutoff) {
+    // solve intensity / (c + l*d + q*d^2) = cutoff for d
+    float target = intensity / cutoff - constAtt;
+    if (target <= 0.0f) return 0.0f;
+    if (quadAtt > 0.0f)
+        return (-linearAtt + sqrt(linearAtt * linearAtt + 4.0f * quadAtt * target)) / (2.0f * quadAtt);
+    if (linearAtt > 0.0f)
+        return target / linearAtt;
+    return UNBOUNDED;
+}
+
+void LightClusters::SetView(const ViewBasis& b, float fovy, float aspect,
+                            float n, float f) {
+    basis = b;
+    float focal = 1.0f / tan(fovy * 0.5f);
+    kx = aspect / focal;
+    ky = 1.0f / focal;
+    znear = n;
+    zfar = f;
+    logDepth = log(zfar / znear);
+
+    // boxes around each frustum segment, x = ndc * z * kx
+    for (unsigned int s = 0; s < slices; ++s) {
+        float z0 = znear * exp(logDepth * s / slices);
+        float z1 = znear * exp(logDepth * (s + 1) / slices);
+        sliceNear[s] = z0;
+        sliceFar[s] = z1;
+        for (unsigned int t = 0; t < tilesX; ++t) {
+            float n0 = -1.0f + 2.0f * t / tilesX;
+            float n1 = -1.0f + 2.0f * (t + 1) / tilesX;
+            tileXLo[s * tilesX + t] = kx * (n0 < 0.0f ? n0 * z1 : n0 * z0);
+            tileXHi[s * tilesX + t] = kx * (n1 > 0.0f ? n1 * z1 : n1 * z0);
+        }
+        for (unsigned int t = 0; t < tilesY; ++t) {
+            float n0 = -1.0f + 2.0f * t / tilesY;
+            float n1 = -1.0f + 2.0f * (t + 1) / tilesY;
+            tileYLo[s * tilesY + t] = ky * (n0 < 0.0f ? n0 * z1 : n0 * z0);
+            tileYHi[s * tilesY + t] = ky * (n1 > 0.0f ? n1 * z1 : n1 * z0);
+        }
+    }
+}
+
+void LightClusters::ClearLights() {
+    lights.clear();
+}
+
+unsigned int LightClusters::AddLight(const Light& light) {
+    lights.push_back(light);
+    Light& l = lights.back();
+    if (l.radius <= 0.0f) {
+        float intensity = l.color[0];
+        if (l.color[1] > intensity) intensity = l.color[1];
+        if (l.color[2] > intensity) intensity = l.color[2];
+        l.radius = AttenuationRadius(l.constAtt, l.linearAtt, l.quadAtt, intensity);
+    }
+    return lights.size() - 1;
+}
+
+void LightClusters::AddLights(ISceneNode* scene) {
+    FindLights(scene);
+}
+
+void LightClusters::FindLights(ISceneNode* node) {
+    if (PointLightNode* pl = dynamic_cast<PointLightNode*>(node)) {
+        Vector<3,float> position, scale(1.0f);
+        Quaternion<float> rotation;
+        GetWorldTransformation(node, position, rotation, scale);
+        Light light;
+        light.position = position;
+        for (unsigned int i = 0; i < 3; ++i)
+            light.color[i] = pl->diffuse[i];
+        light.constAtt = pl->constAtt;
+        light.linearAtt = pl->linearAtt;
+        light.quadAtt = pl->quadAtt;
+        light.radius = 0.0f;
+        AddLight(light);
+    }
+    for (unsigned int i = 0; i < node->GetNumberOfNodes(); ++i)
+        FindLights(node->GetNode(i));
+}
+
+unsigned int LightClusters::GetCluster(const Vector<3,float>& view) const {
+    if (view[2] < znear || view[2] > zfar) return NO_CLUSTER;
+    float fx = (view[0] / (view[2] * kx) + 1.0f) * 0.5f * tilesX;
+    float fy = (view[1] / (view[2] * ky) + 1.0f) * 0.5f * tilesY;
+    if (fx < 0.0f || fy < 0.0f || fx >= tilesX || fy >= tilesY) return NO_CLUSTER;
+    int s = int(log(view[2] / znear) / logDepth * slices);
+    if (s >= int(slices)) s = slices - 1;  // on the far plane
+    return (s * tilesY + int(fy)) * tilesX + int(fx);
+}
+
+bool LightClusters::Overlaps(unsigned int cluster, unsigned int light) const {
+    unsigned int tx = cluster % tilesX;
+    unsigned int ty = (cluster / tilesX) % tilesY;
+    unsigned int s = cluster / (tilesX * tilesY);
+
+    Vector<3,float> v = ToView(lights[light].position);
+    float r = lights[light].radius;
+
+    float lo[3] = { tileXLo[s * tilesX + tx], tileYLo[s * tilesY + ty], sliceNear[s] };
+    float hi[3] = { tileXHi[s * tilesX + tx], tileYHi[s * tilesY + ty], sliceFar[s] };
+    float d2 = 0.0f;
+    for (unsigned int i = 0; i < 3; ++i) {
+        float d = v[i] < lo[i] ? lo[i] - v[i] : (v[i] > hi[i] ? v[i] - hi[i] : 0.0f);
+        d2 += d * d;
+    }
+    return d2 <= r * r;
+}
+
+void LightClusters::Build(unsigned int threads) {
+    // view space structure of arrays, one pass over the lights
+    unsigned int count = lights.size();
+    lx.resize(count); ly.resize(count); lz.resize(count); lr.resize(count);
+    for (unsigned int i = 0; i < count; ++i) {
+        Vector<3,float> v = ToView(lights[i].position);
+        lx[i] = v[0]; ly[i] = v[1]; lz[i] = v[2];
+        lr[i] = lights[i].radius;
+    }
+
+    if (threads > slices) threads = slices;
+    if (threads < 1) threads = 1;
+    if (workers.size() != threads - 1) {
+        StopWorkers();
+        StartWorkers(threads - 1);
+    }
+
+    // the light arrays are in place before nextSlice is reset, so a
+    // worker that claims a slice always sees this build's lights
+    AtomicStore(&doneSlices, 0);
+    AtomicStore(&nextSlice, 0);
+    if (!workers.empty()) AtomicAdd(&generation, 1);
+    BuildSlices(scratch);
+    while (AtomicLoad(&doneSlices) < slices)
+        Core::Thread::Sleep(0);
+
+    // offsets[] already holds the counts, turn them into a prefix sum
+    unsigned int total = 0;
+    for (unsigned int c = 0; c < GetClusterCount(); ++c) {
+        unsigned int n = offsets[c];
+        offsets[c] = total;
+        total += n;
+    }
+    offsets[GetClusterCount()] = total;
+    indices.resize(total);
+    unsigned int* out = total ? &indices[0] : NULL;
+    for (unsigned int s = 0; s < slices; ++s) {
+        for (unsigned int i = 0; i < sliceIndices[s].size(); ++i)
+            *out++ = sliceIndices[s][i];
+    }
+}
+
+void LightClusters::BuildSlices(Scratch& scratch) {
+    // one slice at a time, the near slices are small and cheap
+    unsigned int s;
+    while ((s = AtomicAdd(&nextSlice, 1)) < slices) {
+        BuildSlice(s, scratch);
+        AtomicAdd(&doneSlices, 1);
+    }
+}
+
+void LightClusters::BuildSlice(unsigned int s, Scratch& scratch) {
+    const unsigned int tiles = tilesX * tilesY;
+    const float z0 = sliceNear[s], z1 = sliceFar[s];
+    const float* xlo = &tileXLo[s * tilesX];
+    const float* xhi = &tileXHi[s * tilesX];
+    const float* ylo = &tileYLo[s * tilesY];
+    const float* yhi = &tileYHi[s * tilesY];
+    const unsigned int count = lights.size();
+
+    // reject lights outside the slice's depth range and frustum box in
+    // one branch-free pass over the arrays, compacting the survivors
+    scratch.candidates.resize(count + 1);
+    unsigned int* candidates = &scratch.candidates[0];
+    unsigned int n = 0;
+    if (count > 0) {
+        const float* x = &lx[0];
+        const float* y = &ly[0];
+        const float* z = &lz[0];
+        const float* r = &lr[0];
+        const float left = xlo[0], right = xhi[tilesX - 1];
+        const float bottom = ylo[0], top = yhi[tilesY - 1];
+        for (unsigned int i = 0; i < count; ++i) {
+            candidates[n] = i;
+            n += (z[i] + r[i] >= z0) & (z[i] - r[i] <= z1)
+               & (x[i] + r[i] >= left) & (x[i] - r[i] <= right)
+               & (y[i] + r[i] >= bottom) & (y[i] - r[i] <= top);
+        }
+    }
+
+    // the slice's counts go straight into offsets[], the pairs are
+    // sorted by tile below
+    unsigned int* tileCount = &offsets[s * tiles];
+    for (unsigned int t = 0; t < tiles; ++t)
+        tileCount[t] = 0;
+    scratch.pairTile.clear();
+    scratch.pairLight.clear();
+
+    for (unsigned int c = 0; c < n; ++c) {
+        const unsigned int i = candidates[c];
+        const float x = lx[i], y = ly[i], z = lz[i], r = lr[i];
+
+        // the tile boxes are sorted along each axis, so the tiles
+        // touching the sphere's extent form a contiguous range
+        unsigned int tx0 = 0, tx1 = tilesX, ty0 = 0, ty1 = tilesY;
+        while (tx0 < tilesX && xhi[tx0] < x - r) ++tx0;
+        while (tx1 > tx0 && xlo[tx1 - 1] > x + r) --tx1;
+        while (ty0 < tilesY && yhi[ty0] < y - r) ++ty0;
+        while (ty1 > ty0 && ylo[ty1 - 1] > y + r) --ty1;
+
+        // same sums in the same order as Overlaps()
+        const float r2 = r * r;
+        const float dz = z < z0 ? z0 - z : (z > z1 ? z - z1 : 0.0f);
+        for (unsigned int ty = ty0; ty < ty1; ++ty) {
+            float dy = y < ylo[ty] ? ylo[ty] - y : (y > yhi[ty] ? y - yhi[ty] : 0.0f);
+            if (dy * dy + dz * dz > r2) continue;
+            for (unsigned int tx = tx0; tx < tx1; ++tx) {
+                float dx = x < xlo[tx] ? xlo[tx] - x : (x > xhi[tx] ? x - xhi[tx] : 0.0f);
+                if (dx * dx + dy * dy + dz * dz <= r2) {
+                    unsigned int t = ty * tilesX + tx;
+                    scratch.pairTile.push_back(t);
+                    scratch.pairLight.push_back(i);
+                    ++tileCount[t];
+                }
+            }
+        }
+    }
+
+    // counting sort into this slice's own output list, the lights of
+    // each tile stay in ascending order
+    scratch.tileStart.resize(tiles);
+    unsigned int total = 0;
+    for (unsigned int t = 0; t < tiles; ++t) {
+        scratch.tileStart[t] = total;
+        total += tileCount[t];
+    }
+    vector<unsigned int>& out = sliceIndices[s];
+    out.resize(total);
+    for (unsigned int p = 0; p < total; ++p)
+        out[scratch.tileStart[scratch.pairTile[p]]++] = scratch.pairLight[p];
+}
+
+}
+}
@@ -0,0 +1,157 @@
+// Clustered light culling
+// -------------------------------------------------------------------
+// Copyright (C) 2011 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _LIGHT_CLUSTERS_H_
+#define _LIGHT_CLUSTERS_H_
+
+#include "ViewBasis.h"
+
+#include <Math/Vector.h>
+
+#include <cstddef>
+#include <vector>
+
+namespace OpenEngine {
+    namespace Scene {
+        class ISceneNode;
+    }
+namespace Renderers {
+
+/**
+ * Bins point lights into a view space cluster grid.
+ *
+ * The view frustum is split into tilesX x tilesY screen tiles and
+ * exponentially spaced depth slices. Each light is given a radius
+ * from its attenuation, and Build() lists for every cluster the
+ * lights whose sphere touches the cluster's bounding box. The lists
+ * are stored flat, an offset per cluster into one index array, so
+ * they can be uploaded as is for shading.
+ *
+ * Light positions are kept as separate x, y, z and radius arrays,
+ * and slices are binned in parallel with one output list per slice.
+ * The threads are kept between builds, see Build().
+ */
+class LightClusters {
+public:
+    // GetCluster() result for points outside the grid.
+    static const unsigned int NO_CLUSTER = 0xFFFFFFFF;
+
+    struct Light {
+        Math::Vector<3,float> position;
+        Math::Vector<3,float> color;
+        float constAtt, linearAtt, quadAtt;
+        // computed by AddLight() when not positive
+        float radius;
+    };
+
+private:
+    unsigned int tilesX, tilesY, slices;
+
+    // view basis and projection
+    ViewBasis basis;
+    float kx, ky, znear, zfar, logDepth;
+
+    // bounds of the cluster boxes, per slice and tile
+    std::vector<float> sliceNear, sliceFar;
+    std::vector<float> tileXLo, tileXHi, tileYLo, tileYHi;
+
+    std::vector<Light> lights;
+    std::vector<float> lx, ly, lz, lr;
+
+    std::vector<unsigned int> offsets, indices;
+    std::vector<std::vector<unsigned int> > sliceIndices;
+
+    // binning buffers of one thread, reused between builds
+    struct Scratch {
+        std::vector<unsigned int> candidates;
+        std::vector<unsigned int> pairTile, pairLight, tileStart;
+    };
+    Scratch scratch;
+
+    // worker threads live until the thread count changes, Build()
+    // bumps generation to wake them and they claim slices from
+    // nextSlice alongside the calling thread
+    class Worker;
+    friend class Worker;
+    std::vector<Worker*> workers;
+    volatile unsigned int generation, nextSlice, doneSlices, stopping;
+
+    void StartWorkers(unsigned int count);
+    void StopWorkers();
+    void BuildSlices(Scratch& scratch);
+    void BuildSlice(unsigned int slice, Scratch& scratch);
+    void FindLights(Scene::ISceneNode* node);
+
+    // the workers point back at this object and are owned by it
+    LightClusters(const LightClusters&);
+    LightClusters& operator=(const LightClusters&);
+
+public:
+    LightClusters(unsigned int tilesX = 16, unsigned int tilesY = 8, unsigned int slices = 24);
+    virtual ~LightClusters();
+
+    /**
+     * Distance at which the attenuated intensity drops below cutoff.
+     */
+    static float AttenuationRadius(float constAtt, float linearAtt, float quadAtt,
+                                   float intensity = 1.0f, float cutoff = 1.0f / 256.0f);
+
+    void SetView(const ViewBasis& basis, float fovy, float aspect,
+                 float znear, float zfar);
+
+    void ClearLights();
+    unsigned int AddLight(const Light& light);
+
+    /**
+     * Add every PointLightNode in the scene, placed by the closest
+     * transformation node above it.
+     */
+    void AddLights(Scene::ISceneNode* scene);
+
+    /**
+     * Bin the lights for the current view. With more than one thread,
+     * threads - 1 workers are started on the first call and reused by
+     * later calls with the same count; the calling thread bins too.
+     */
+    void Build(unsigned int threads = 1);
+
+    Math::Vector<3,float> ToView(const Math::Vector<3,float>& world) const {
+        return basis.ToView(world);
+    }
+
+    /**
+     * Cluster containing a view space point, or NO_CLUSTER if it is
+     * off screen, in front of the near or beyond the far plane. No
+     * list covers those points, callers must test every light there.
+     */
+    unsigned int GetCluster(const Math::Vector<3,float>& view) const;
+
+    /**
+     * Exact sphere against cluster box test that Build() bins with.
+     */
+    bool Overlaps(unsigned int cluster, unsigned int light) const;
+
+    const unsigned int* GetClusterLights(unsigned int cluster, unsigned int& count) const {
+        count = offsets[cluster + 1] - offsets[cluster];
+        return count ? &indices[offsets[cluster]] : NULL;
+    }
+
+    unsigned int GetClusterCount() const { return tilesX * tilesY * slices; }
+    unsigned int GetLightCount() const { return lights.size(); }
+    const Light& GetLight(unsigned int i) const { return lights[i]; }
+
+    // Flat layout, cluster c owns indices [offsets[c], offsets[c + 1]).
+    const std::vector<unsigned int>& GetOffsets() const { return offsets; }
+    const std::vector<unsigned int>& GetIndices() const { return indices; }
+};
+
+}
+}
+
+#endif // _LIGHT_CLUSTERS_H_
@@ -0,0 +1,325 @@
+// Software renderer
+// -------------------------------------------------------------------
+// Copyright (C) 2011 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include "SoftwareRenderer.h"
+#include "LightClusters.h"
+
+#include <Geometry/Mesh.h>
+#include <Geometry/Material.h>
+#include <Geometry/GeometrySet.h>
+#include <Math/Vector.h>
+#include <Math/Quaternion.h>
+#include <Scene/ISceneNode.h>
+#include <Scene/MeshNode.h>
+
+#include <cmath>
+
+namespace OpenEngine {
+namespace Renderers {
+
+using namespace Geometry;
+using namespace Math;
+using namespace Scene;
+using namespace std;
+
+// Blinn-Phong contribution of one light at p, added to c.
+static inline void Shade(const Vector<3,float>& p, const Vector<3,float>& n,
+                         const Vector<3,float>& v, const Vector<3,float>& light,
+                         const Vector<3,float>& color, float att,
+                         const Vector<3,float>& diffuse, const Material* mat, float* c) {
+    Vector<3,float> l = Normalized(light - p);
+    Vector<3,float> half = Normalized(l + v);
+
+    float ndl = n * l;
+    if (ndl <= 0.0f) return;
+    float ndh = n * half;
+    float spec = ndh > 0.0f ? pow(ndh, mat->shininess) : 0.0f;
+    for (unsigned int k = 0; k < 3; ++k)
+        c[k] += att * color[k] * (diffuse[k] * ndl + mat->specular[k] * spec);
+}
+
+static inline unsigned char ToByte(float c) {
+    if (c <= 0.0f) return 0;
+    if (c >= 1.0f) return 255;
+    return (unsigned char)(c * 255.0f + 0.5f);
+}
+
+// A triangle corner in view space with its lit color.
+struct ClipVertex {
+    float view[3];
+    float color[3];
+};
+
+// Clip a triangle against the near plane, giving a polygon of zero,
+// three or four corners.
+static unsigned int ClipNear(const ClipVertex* in, float znear, ClipVertex* out) {
+    unsigned int n = 0;
+    for (unsigned int i = 0; i < 3; ++i) {
+        const ClipVertex& a = in[i];
+        const ClipVertex& b = in[(i + 1) % 3];
+        bool aIn = a.view[2] >= znear, bIn = b.view[2] >= znear;
+        if (aIn) out[n++] = a;
+        if (aIn == bIn) continue;
+        float t = (znear - a.view[2]) / (b.view[2] - a.view[2]);
+        ClipVertex& c = out[n++];
+        for (unsigned int k = 0; k < 3; ++k) {
+            c.view[k] = a.view[k] + t * (b.view[k] - a.view[k]);
+            c.color[k] = a.color[k] + t * (b.color[k] - a.color[k]);
+        }
+        c.view[2] = znear;
+    }
+    return n;
+}
+
+// Screen x, y and 1/z of a view space point in front of the camera.
+static inline void Project(const float* v, float kx, float ky,
+                           unsigned int w, unsigned int h, float* s) {
+    s[0] = (v[0] * kx / v[2] + 1.0f) * 0.5f * w;
+    s[1] = (1.0f - v[1] * ky / v[2]) * 0.5f * h;
+    s[2] = 1.0f / v[2];
+}
+
+// Scan convert one screen space triangle with Gouraud colors.
+static void Raster(const float* s0, const float* s1, const float* s2,
+                   const float* c0, const float* c1, const float* c2,
+                   float alpha, bool writeDepth, SoftwareRenderer::Target& target) {
+    const unsigned int w = target.width, h = target.height;
+    float area = (s1[0] - s0[0]) * (s2[1] - s0[1]) - (s1[1] - s0[1]) * (s2[0] - s0[0]);
+    if (fabs(area) < 1e-8f) return;
+    float invArea = 1.0f / area;
+
+    float minx = s0[0] < s1[0] ? s0[0] : s1[0]; if (s2[0] < minx) minx = s2[0];
+    float maxx = s0[0] > s1[0] ? s0[0] : s1[0]; if (s2[0] > maxx) maxx = s2[0];
+    float miny = s0[1] < s1[1] ? s0[1] : s1[1]; if (s2[1] < miny) miny = s2[1];
+    float maxy = s0[1] > s1[1] ? s0[1] : s1[1]; if (s2[1] > maxy) maxy = s2[1];
+    if (maxx < 0.0f || maxy < 0.0f || minx >= w || miny >= h) return;
+    int x0 = minx < 0.0f ? 0 : int(minx);
+    int y0 = miny < 0.0f ? 0 : int(miny);
+    int x1 = maxx >= w ? w - 1 : int(maxx);
+    int y1 = maxy >= h ? h - 1 : int(maxy);
+
+    for (int y = y0; y <= y1; ++y) {
+        float py = y + 0.5f;
+        for (int x = x0; x <= x1; ++x) {
+            float px = x + 0.5f;
+            float b0 = ((s1[0] - px) * (s2[1] - py) - (s1[1] - py) * (s2[0] - px)) * invArea;
+            float b1 = ((s2[0] - px) * (s0[1] - py) - (s2[1] - py) * (s0[0] - px)) * invArea;
+            float b2 = 1.0f - b0 - b1;
+            if (b0 < 0.0f || b1 < 0.0f || b2 < 0.0f) continue;
+
+            float invz = b0 * s0[2] + b1 * s1[2] + b2 * s2[2];
+            unsigned int i = y * w + x;
+            if (invz <= target.depth[i]) continue;
+
+            unsigned char* out = &target.color[i * 3];
+            for (unsigned int k = 0; k < 3; ++k) {
+                float c = b0 * c0[k] + b1 * c1[k] + b2 * c2[k];
+                if (alpha < 1.0f) c = c * alpha + (out[k] / 255.0f) * (1.0f - alpha);
+                out[k] = ToByte(c);
+            }
+            if (writeDepth) target.depth[i] = invz;
+        }
+    }
+}
+
+SoftwareRenderer::View::View()
+    : width(800), height(600)
+    , basis(Vector<3,float>(0.0f, 0.0f, 20.0f), Vector<3,float>(0.0f))
+    , light(0.0f)
+    , fovy(0.7853982f), znear(1.0f)
+    , constAtt(1.0f), linearAtt(0.0f)
+    , clusters(NULL) {
+    for (unsigned int i = 0; i < 3; ++i)
+        background[i] = 0.5f;
+}
+
+void SoftwareRenderer::Target::Resize(unsigned int w, unsigned int h) {
+    if (w == width && h == height) return;
+    width = w;
+    height = h;
+    color.resize(w * h * 3);
+    depth.resize(w * h);
+}
+
+SoftwareRenderer::SoftwareRenderer(ISceneNode* scene) {
+    Flatten(scene);
+}
+
+SoftwareRenderer::~SoftwareRenderer() {}
+
+void SoftwareRenderer::Flatten(ISceneNode* node) {
+    MeshNode* mn = dynamic_cast<MeshNode*>(node);
+    if (mn && mn->GetMesh() && mn->GetMesh()->GetType() == TRIANGLES) {
+        MeshPtr mesh = mn->GetMesh();
+        IDataBlockPtr verts = mesh->GetGeometrySet()->GetVertices();
+        IDataBlockPtr norms = mesh->GetGeometrySet()->GetNormals();
+        IndicesPtr ids = mesh->GetIndices();
+
+        Vector<3,float> position, scale(1.0f);
+        Quaternion<float> rotation;
+        GetWorldTransformation(node, position, rotation, scale);
+
+        Batch batch;
+        batch.material = mesh->GetMaterial().get();
+        batch.name = batch.material->GetName();
+        batch.transparent = batch.material->transparency > 0.0f;
+        batch.firstVertex = positions.size() / 3;
+        batch.vertexCount = verts->GetSize();
+        batch.firstIndex = indices.size();
+
+        for (unsigned int i = 0; i < verts->GetSize(); ++i) {
+            Vector<3,float> v, n(0.0f, 1.0f, 0.0f);
+            verts->GetElement(i, v);
+            if (norms) norms->GetElement(i, n);
+            v = rotation.RotateVector(Vector<3,float>(v[0]*scale[0], v[1]*scale[1], v[2]*scale[2])) + position;
+            n = Normalized(rotation.RotateVector(Vector<3,float>(n[0]/scale[0], n[1]/scale[1], n[2]/scale[2])));
+            for (unsigned int c = 0; c < 3; ++c) {
+                positions.push_back(v[c]);
+                normals.push_back(n[c]);
+            }
+        }
+
+        unsigned int* data = ids->GetData();
+        unsigned int count = mesh->GetDrawingRange();
+        if (count == 0) count = ids->GetSize() - mesh->GetIndexOffset();
+        count -= count % 3;
+        for (unsigned int i = 0; i < count; ++i)
+            indices.push_back(data[mesh->GetIndexOffset() + i]);
+        batch.indexCount = count;
+
+        if (batch.indexCount > 0)
+            batches.push_back(batch);
+    }
+
+    for (unsigned int i = 0; i < node->GetNumberOfNodes(); ++i)
+        Flatten(node->GetNode(i));
+}
+
+void SoftwareRenderer::Render(const View& view, const MaterialOverrides& overrides, Target& target) const {
+    target.Resize(view.width, view.height);
+
+    unsigned char bg[3] = { ToByte(view.background[0]),
+                            ToByte(view.background[1]),
+                            ToByte(view.background[2]) };
+    for (unsigned int i = 0; i < view.width * view.height; ++i) {
+        target.color[i*3    ] = bg[0];
+        target.color[i*3 + 1] = bg[1];
+        target.color[i*3 + 2] = bg[2];
+        target.depth[i] = 0.0f;
+    }
+
+    // opaque geometry first, blended geometry on top of it
+    for (unsigned int pass = 0; pass < 2; ++pass) {
+        for (vector<Batch>::const_iterator b = batches.begin(); b != batches.end(); ++b) {
+            if (b->transparent != (pass == 1)) continue;
+            Vector<3,float> diffuse(b->material->diffuse[0],
+                                    b->material->diffuse[1],
+                                    b->material->diffuse[2]);
+            MaterialOverrides::const_iterator o = overrides.find(b->name);
+            if (o != overrides.end() && o->second.size() >= 3)
+                diffuse = Vector<3,float>(o->second[0], o->second[1], o->second[2]);
+            Draw(*b, view, diffuse, target);
+        }
+    }
+}
+
+void SoftwareRenderer::Draw(const Batch& batch, const View& view, const Vector<3,float>& diffuse,
+                            Target& target) const {
+    const Material* mat = batch.material;
+    const unsigned int w = view.width, h = view.height;
+    const Vector<3,float>& eye = view.basis.eye;
+
+    const float focal = 1.0f / tan(view.fovy * 0.5f);
+    const float kx = focal * float(h) / float(w), ky = focal;
+    const Vector<3,float> white(1.0f);
+
+    // vertex stage: light and project every vertex of the batch once
+    if (target.lit.size() < batch.vertexCount * 3) {
+        target.lit.resize(batch.vertexCount * 3);
+        target.view.resize(batch.vertexCount * 3);
+        target.screen.resize(batch.vertexCount * 3);
+    }
+    for (unsigned int i = 0; i < batch.vertexCount; ++i) {
+        const float* fp = &positions[(batch.firstVertex + i) * 3];
+        const float* fn = &normals[(batch.firstVertex + i) * 3];
+        Vector<3,float> p(fp[0], fp[1], fp[2]), n(fn[0], fn[1], fn[2]);
+        Vector<3,float> v = Normalized(eye - p);
+        // two sided lighting, backface culling is off in the viewer
+        if (n * v < 0.0f) n = n * -1.0f;
+
+        float* c = &target.lit[i * 3];
+        for (unsigned int k = 0; k < 3; ++k)
+            c[k] = mat->ambient[k] * diffuse[k];
+
+        float att = 1.0f / (view.constAtt + view.linearAtt * (view.light - p).GetLength());
+        Shade(p, n, v, view.light, white, att, diffuse, mat, c);
+
+        const Vector<3,float> vp = view.basis.ToView(p);
+        if (view.clusters) {
+            // outside the grid no list applies, fall back to every light
+            unsigned int count = view.clusters->GetLightCount();
+            const unsigned int* ids = NULL;
+            unsigned int cluster = view.clusters->GetCluster(vp);
+            if (cluster != LightClusters::NO_CLUSTER)
+                ids = view.clusters->GetClusterLights(cluster, count);
+            for (unsigned int j = 0; j < count; ++j) {
+                const LightClusters::Light& light = view.clusters->GetLight(ids ? ids[j] : j);
+                float d = (light.position - p).GetLength();
+                if (d > light.radius) continue;
+                att = 1.0f / (light.constAtt + light.linearAtt * d + light.quadAtt * d * d);
+                Shade(p, n, v, light.position, light.color, att, diffuse, mat, c);
+            }
+        }
+
+        float* out = &target.view[i * 3];
+        out[0] = vp[0]; out[1] = vp[1]; out[2] = vp[2];
+        if (vp[2] >= view.znear)
+            Project(out, kx, ky, w, h, &target.screen[i * 3]);
+    }
+
+    const float alpha = batch.transparent ? 1.0f - mat->transparency : 1.0f;
+    const unsigned int* tri = &indices[batch.firstIndex];
+    for (unsigned int t = 0; t < batch.indexCount; t += 3) {
+        if (tri[t] >= batch.vertexCount || tri[t + 1] >= batch.vertexCount ||
+            tri[t + 2] >= batch.vertexCount) continue;
+
+        unsigned int front = 0;
+        for (unsigned int k = 0; k < 3; ++k)
+            if (target.view[tri[t + k] * 3 + 2] >= view.znear) ++front;
+
+        if (front == 3) {
+            Raster(&target.screen[tri[t] * 3], &target.screen[tri[t + 1] * 3],
+                   &target.screen[tri[t + 2] * 3],
+                   &target.lit[tri[t] * 3], &target.lit[tri[t + 1] * 3],
+                   &target.lit[tri[t + 2] * 3],
+                   alpha, !batch.transparent, target);
+            continue;
+        }
+        if (front == 0) continue;
+
+        // crosses the near plane, rasterize the clipped polygon as a fan
+        ClipVertex in[3], out[4];
+        for (unsigned int k = 0; k < 3; ++k)
+            for (unsigned int c = 0; c < 3; ++c) {
+                in[k].view[c] = target.view[tri[t + k] * 3 + c];
+                in[k].color[c] = target.lit[tri[t + k] * 3 + c];
+            }
+        unsigned int n = ClipNear(in, view.znear, out);
+        float screen[4][3];
+        for (unsigned int k = 0; k < n; ++k)
+            Project(out[k].view, kx, ky, w, h, screen[k]);
+        for (unsigned int k = 1; k + 1 < n; ++k)
+            Raster(screen[0], screen[k], screen[k + 1],
+                   out[0].color, out[k].color, out[k + 1].color,
+                   alpha, !batch.transparent, target);
+    }
+}
+
+}
+}
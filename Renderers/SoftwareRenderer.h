@@ -0,0 +1,105 @@
+// Software renderer
+// -------------------------------------------------------------------
+// Copyright (C) 2011 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _SOFTWARE_RENDERER_H_
+#define _SOFTWARE_RENDERER_H_
+
+#include "ViewBasis.h"
+
+#include <Math/Vector.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace OpenEngine {
+    namespace Geometry {
+        class Material;
+    }
+    namespace Scene {
+        class ISceneNode;
+    }
+namespace Renderers {
+
+class LightClusters;
+
+/**
+ * CPU rasterizer for offscreen rendering without a GL context.
+ *
+ * The scene is flattened into world space triangle lists once at
+ * construction and never modified afterwards, so any number of
+ * threads can render from one renderer, each into its own Target.
+ * Shading is per vertex Blinn-Phong from a point light following the
+ * camera plus, optionally, the lights of each vertex's cluster. Only
+ * material colors are used, textures are ignored.
+ */
+class SoftwareRenderer {
+public:
+    // Diffuse color replacements keyed by material name.
+    typedef std::map<std::string, std::vector<float> > MaterialOverrides;
+
+    struct View {
+        unsigned int width, height;
+        // camera frame, the light clusters must be built with the same
+        ViewBasis basis;
+        Math::Vector<3,float> light;
+        float fovy, znear;
+        float constAtt, linearAtt;
+        float background[3];
+        // additional lights, built for this view, may be NULL
+        const LightClusters* clusters;
+        View();
+    };
+
+    /**
+     * Per thread frame and scratch buffers, reused between renders of
+     * the same resolution. Pixels are RGB, top row first.
+     */
+    class Target {
+    public:
+        unsigned int width, height;
+        std::vector<unsigned char> color;
+        std::vector<float> depth;
+        std::vector<float> lit;
+        std::vector<float> view;
+        std::vector<float> screen;
+        Target() : width(0), height(0) {}
+        void Resize(unsigned int width, unsigned int height);
+    };
+
+private:
+    struct Batch {
+        Geometry::Material* material;
+        std::string name;
+        unsigned int firstVertex, vertexCount;
+        unsigned int firstIndex, indexCount;
+        bool transparent;
+    };
+
+    std::vector<Batch> batches;
+    std::vector<float> positions, normals;
+    std::vector<unsigned int> indices;
+
+    void Flatten(Scene::ISceneNode* node);
+    void Draw(const Batch& batch, const View& view, const Math::Vector<3,float>& diffuse,
+              Target& target) const;
+
+public:
+    SoftwareRenderer(Scene::ISceneNode* scene);
+    virtual ~SoftwareRenderer();
+
+    void Render(const View& view, const MaterialOverrides& overrides, Target& target) const;
+
+    unsigned int GetTriangleCount() const { return indices.size() / 3; }
+};
+
+}
+}
+
+#endif // _SOFTWARE_RENDERER_H_
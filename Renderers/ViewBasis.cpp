@@ -0,0 +1,49 @@
+// View basis shared by the CPU renderers
+// -------------------------------------------------------------------
+// Copyright (C) 2011 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include "ViewBasis.h"
+
+#include <Scene/ISceneNode.h>
+#include <Scene/TransformationNode.h>
+
+#include <cmath>
+
+namespace OpenEngine {
+namespace Renderers {
+
+using namespace Math;
+using namespace Scene;
+
+ViewBasis::ViewBasis()
+    : eye(0.0f), right(1.0f, 0.0f, 0.0f)
+    , up(0.0f, 1.0f, 0.0f), forward(0.0f, 0.0f, -1.0f) {}
+
+ViewBasis::ViewBasis(const Vector<3,float>& e, const Vector<3,float>& center)
+    : eye(e) {
+    forward = Normalized(center - eye);
+    // looking straight up or down the world y axis, take world z as
+    // the reference instead or right would have no length
+    Vector<3,float> worldUp(0.0f, 1.0f, 0.0f);
+    if (fabs(forward[1]) > 0.9999f) worldUp = Vector<3,float>(0.0f, 0.0f, 1.0f);
+    right = Normalized(forward % worldUp);
+    up = right % forward;
+}
+
+void GetWorldTransformation(ISceneNode* node, Vector<3,float>& position,
+                            Quaternion<float>& rotation, Vector<3,float>& scale) {
+    for (ISceneNode* p = node->GetParent(); p; p = p->GetParent()) {
+        if (TransformationNode* tn = dynamic_cast<TransformationNode*>(p)) {
+            tn->GetAccumulatedTransformations(&position, &rotation, &scale);
+            return;
+        }
+    }
+}
+
+}
+}
@@ -0,0 +1,64 @@
+// View basis shared by the CPU renderers
+// -------------------------------------------------------------------
+// Copyright (C) 2011 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _VIEW_BASIS_H_
+#define _VIEW_BASIS_H_
+
+#include <Math/Vector.h>
+#include <Math/Quaternion.h>
+
+namespace OpenEngine {
+    namespace Scene {
+        class ISceneNode;
+    }
+namespace Renderers {
+
+/**
+ * Camera frame of a look-at view: x right, y up and z along the view
+ * direction, with the world y axis as up, or the world z axis when
+ * looking along y.
+ *
+ * The software renderer and the light clusters map points through the
+ * same basis, so a vertex is looked up in the cluster its lights were
+ * binned for.
+ */
+class ViewBasis {
+public:
+    Math::Vector<3,float> eye, right, up, forward;
+
+    ViewBasis();
+    ViewBasis(const Math::Vector<3,float>& eye, const Math::Vector<3,float>& center);
+
+    Math::Vector<3,float> ToView(const Math::Vector<3,float>& world) const {
+        Math::Vector<3,float> rel = world - eye;
+        return Math::Vector<3,float>(rel * right, rel * up, rel * forward);
+    }
+};
+
+/**
+ * Unit vector along v, or v itself if it has no length.
+ */
+inline Math::Vector<3,float> Normalized(const Math::Vector<3,float>& v) {
+    float l = v.GetLength();
+    return l > 0.0f ? v * (1.0f / l) : v;
+}
+
+/**
+ * Accumulated transformation of the closest TransformationNode above
+ * node. The outputs are left untouched if there is none.
+ */
+void GetWorldTransformation(Scene::ISceneNode* node,
+                            Math::Vector<3,float>& position,
+                            Math::Quaternion<float>& rotation,
+                            Math::Vector<3,float>& scale);
+
+}
+}
+
+#endif // _VIEW_BASIS_H_
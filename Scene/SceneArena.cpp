@@ -0,0 +1,156 @@
+// Scene arena
+// -------------------------------------------------------------------
+// Copyright (C) 2011 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include "SceneArena.h"
+
+#include <Logging/Logger.h>
+#include <Scene/ISceneNode.h>
+#include <Scene/SceneNode.h>
+#include <Scene/TransformationNode.h>
+#include <Scene/MeshNode.h>
+
+#include <typeinfo>
+
+namespace OpenEngine {
+namespace Scene {
+
+using namespace Geometry;
+
+// Every allocation is rounded up to keep doubles and pointers aligned.
+static const size_t ALIGN = 16;
+
+static size_t AlignUp(size_t size) {
+    return (size + ALIGN - 1) & ~(ALIGN - 1);
+}
+
+static bool CanClone(ISceneNode* node) {
+    const std::type_info& type = typeid(*node);
+    if (type != typeid(SceneNode) &&
+        type != typeid(TransformationNode) &&
+        type != typeid(MeshNode))
+        return false;
+    for (unsigned int i = 0; i < node->GetNumberOfNodes(); ++i)
+        if (!CanClone(node->GetNode(i))) return false;
+    return true;
+}
+
+SceneArena::SceneArena(size_t blockSize)
+    : blocks(NULL)
+    , finalizers(NULL)
+    , blockSize(blockSize)
+    , allocations(0)
+    , blockCount(0)
+    , liveShared(new unsigned int(0))
+    , bytes(0) {}
+
+SceneArena::~SceneArena() {
+    if (Release())
+        delete liveShared;
+    else
+        logger.error << "SceneArena destroyed with " << *liveShared
+                     << " meshes still referenced, its memory is leaked." << logger.end;
+}
+
+void* SceneArena::Allocate(size_t size) {
+    size = AlignUp(size);
+    const size_t header = AlignUp(sizeof(Block));
+    if (!blocks || blocks->used + size > blocks->size) {
+        size_t capacity = size > blockSize - header ? size : blockSize - header;
+        Block* b = static_cast<Block*>(::operator new(header + capacity));
+        b->size = capacity;
+        b->used = 0;
+        b->next = blocks;
+        blocks = b;
+        ++blockCount;
+    }
+    void* p = reinterpret_cast<char*>(blocks) + header + blocks->used;
+    blocks->used += size;
+    bytes += size;
+    ++allocations;
+    return p;
+}
+
+MeshPtr SceneArena::CreateMesh(MeshPtr mesh, MaterialPtr mat) {
+    return boost::allocate_shared<Mesh>(Allocator<Mesh>(this),
+                                        mesh->GetIndices(), mesh->GetType(),
+                                        mesh->GetGeometrySet(), mat,
+                                        mesh->GetIndexOffset(),
+                                        mesh->GetDrawingRange());
+}
+
+bool SceneArena::Owns(const void* p) const {
+    const size_t header = AlignUp(sizeof(Block));
+    for (Block* b = blocks; b; b = b->next) {
+        const char* begin = reinterpret_cast<const char*>(b) + header;
+        if (p >= begin && p < begin + b->used) return true;
+    }
+    return false;
+}
+
+ISceneNode* SceneArena::Clone(ISceneNode* node) {
+    if (!CanClone(node)) return NULL;
+    return CloneNode(node);
+}
+
+ISceneNode* SceneArena::CloneNode(ISceneNode* node) {
+    ISceneNode* copy;
+    if (TransformationNode* tn = dynamic_cast<TransformationNode*>(node)) {
+        TransformationNode* t = Create<TransformationNode>();
+        t->SetPosition(tn->GetPosition());
+        t->SetRotation(tn->GetRotation());
+        t->SetScale(tn->GetScale());
+        copy = t;
+    }
+    else if (MeshNode* mn = dynamic_cast<MeshNode*>(node)) {
+        MeshPtr mesh = mn->GetMesh();
+        copy = Create<MeshNode>(CreateMesh(mesh, mesh->GetMaterial()));
+    }
+    else copy = Create<SceneNode>();
+
+    for (unsigned int i = 0; i < node->GetNumberOfNodes(); ++i)
+        copy->AddNode(CloneNode(node->GetNode(i)));
+    return copy;
+}
+
+bool SceneArena::Release() {
+    // Empty the child lists so no destructor walks into arena memory.
+    // Taking the front child each time keeps every removal constant
+    // time, and afterwards only roots hanging below nodes outside the
+    // arena still have a parent.
+    for (Finalizer* f = finalizers; f; f = f->prev)
+        if (f->node)
+            while (f->node->GetNumberOfNodes() > 0)
+                f->node->RemoveNode(f->node->GetNode(0));
+    for (Finalizer* f = finalizers; f; f = f->prev)
+        if (f->node && f->node->GetParent() && !Owns(f->node->GetParent()))
+            f->node->GetParent()->RemoveNode(f->node);
+
+    // newest first, children go before their parents
+    for (Finalizer* f = finalizers; f; f = f->prev)
+        f->destroy(f->object);
+    finalizers = NULL;
+
+    if (*liveShared > 0) {
+        logger.error << "SceneArena: " << *liveShared
+                     << " meshes still referenced, blocks not freed." << logger.end;
+        return false;
+    }
+
+    while (blocks) {
+        Block* next = blocks->next;
+        ::operator delete(blocks);
+        blocks = next;
+    }
+    allocations = blockCount = 0;
+    bytes = 0;
+    return true;
+}
+
+}
+}
@@ -0,0 +1,164 @@
+// Scene arena
+// -------------------------------------------------------------------
+// Copyright (C) 2011 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _SCENE_ARENA_H_
+#define _SCENE_ARENA_H_
+
+#include <Geometry/Mesh.h>
+#include <Geometry/Material.h>
+
+#include <boost/make_shared.hpp>
+#include <cstddef>
+#include <new>
+
+namespace OpenEngine {
+namespace Scene {
+
+class ISceneNode;
+
+/**
+ * Bump allocator for the scene nodes and meshes of one asset.
+ *
+ * Objects are placed back to back in large blocks, so a graph built
+ * depth first is laid out in traversal order. Nothing is freed
+ * individually; Release() detaches the arena roots from their
+ * parents outside the arena, runs the destructors and returns the
+ * blocks in one go.
+ *
+ * Meshes are handed out as MeshPtr with the shared count inside the
+ * arena too. While any of them is still referenced Release() keeps
+ * the blocks, so a stray MeshPtr never points into freed memory.
+ */
+class SceneArena {
+private:
+    struct Block {
+        Block* next;
+        size_t size, used;
+    };
+
+    struct Finalizer {
+        void (*destroy)(void*);
+        void* object;
+        ISceneNode* node;
+        Finalizer* prev;
+    };
+
+    Block* blocks;
+    Finalizer* finalizers;
+    size_t blockSize;
+    unsigned int allocations, blockCount;
+    // outlives the arena if meshes are still referenced when it is
+    // destroyed, their allocators decrement it
+    unsigned int* liveShared;
+    size_t bytes;
+
+    template <class T> static void Destroy(void* p) {
+        static_cast<T*>(p)->~T();
+    }
+
+    static ISceneNode* AsNode(ISceneNode* node) { return node; }
+    static ISceneNode* AsNode(const void*) { return NULL; }
+
+    template <class T> T* Track(T* obj) {
+        Finalizer* f = static_cast<Finalizer*>(Allocate(sizeof(Finalizer)));
+        f->destroy = &Destroy<T>;
+        f->object = obj;
+        f->node = AsNode(obj);
+        f->prev = finalizers;
+        finalizers = f;
+        return obj;
+    }
+
+    ISceneNode* CloneNode(ISceneNode* node);
+    bool Owns(const void* p) const;
+
+public:
+    /**
+     * Standard allocator over the arena, for shared pointer control
+     * blocks and the like. deallocate() only does book keeping.
+     */
+    template <class T> class Allocator {
+    public:
+        typedef T value_type;
+        typedef T* pointer;
+        typedef const T* const_pointer;
+        typedef T& reference;
+        typedef const T& const_reference;
+        typedef size_t size_type;
+        typedef ptrdiff_t difference_type;
+        template <class U> struct rebind { typedef Allocator<U> other; };
+
+        SceneArena* arena;
+        unsigned int* live;
+
+        Allocator(SceneArena* arena) : arena(arena), live(arena->liveShared) {}
+        template <class U> Allocator(const Allocator<U>& other)
+            : arena(other.arena), live(other.live) {}
+
+        pointer address(reference r) const { return &r; }
+        const_pointer address(const_reference r) const { return &r; }
+        size_type max_size() const { return size_t(-1) / sizeof(T); }
+        void construct(pointer p, const T& v) { new (p) T(v); }
+        void destroy(pointer p) { p->~T(); }
+
+        pointer allocate(size_type n, const void* = 0) {
+            ++*live;
+            return static_cast<pointer>(arena->Allocate(n * sizeof(T)));
+        }
+        void deallocate(pointer, size_type) {
+            --*live;
+        }
+
+        template <class U> bool operator==(const Allocator<U>& o) const { return arena == o.arena; }
+        template <class U> bool operator!=(const Allocator<U>& o) const { return arena != o.arena; }
+    };
+
+    SceneArena(size_t blockSize = 64 * 1024);
+    virtual ~SceneArena();
+
+    void* Allocate(size_t size);
+
+    // Construct objects in the arena, destroyed by Release().
+    template <class T> T* Create() {
+        return Track(new (Allocate(sizeof(T))) T());
+    }
+    template <class T, class A1> T* Create(const A1& a1) {
+        return Track(new (Allocate(sizeof(T))) T(a1));
+    }
+
+    /**
+     * A copy of the mesh in the arena, sharing its geometry set and
+     * indices but with the given material.
+     */
+    Geometry::MeshPtr CreateMesh(Geometry::MeshPtr mesh, Geometry::MaterialPtr mat);
+
+    /**
+     * Deep copy a graph of scene, transformation and mesh nodes into
+     * the arena, depth first. Returns NULL if the graph holds other
+     * node types, in which case nothing is allocated.
+     */
+    ISceneNode* Clone(ISceneNode* node);
+
+    /**
+     * Destroy everything in the arena and free its blocks. Returns
+     * false, and keeps the blocks, if meshes from the arena are still
+     * referenced outside it; call again once they are dropped.
+     */
+    bool Release();
+
+    unsigned int GetAllocations() const { return allocations; }
+    unsigned int GetBlockCount() const { return blockCount; }
+    size_t GetBytes() const { return bytes; }
+    unsigned int GetLiveMeshes() const { return *liveShared; }
+};
+
+}
+}
+
+#endif // _SCENE_ARENA_H_
@@ -0,0 +1,78 @@
+// Atomic operations on 32 bit counters
+// -------------------------------------------------------------------
+// Copyright (C) 2011 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _UTILS_ATOMIC_H_
+#define _UTILS_ATOMIC_H_
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace OpenEngine {
+namespace Utils {
+
+// Acquire/release loads, stores and exchanges. The Interlocked calls
+// are full barriers, so Win32 is always at least as strong.
+inline unsigned int AtomicLoad(volatile unsigned int* p) {
+#ifdef _WIN32
+    return InterlockedCompareExchange((volatile LONG*)p, 0, 0);
+#else
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#endif
+}
+
+inline void AtomicStore(volatile unsigned int* p, unsigned int v) {
+#ifdef _WIN32
+    InterlockedExchange((volatile LONG*)p, v);
+#else
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+#endif
+}
+
+inline bool AtomicCAS(volatile unsigned int* p, unsigned int expected, unsigned int v) {
+#ifdef _WIN32
+    return (unsigned int)InterlockedCompareExchange((volatile LONG*)p, v, expected) == expected;
+#else
+    return __atomic_compare_exchange_n(p, &expected, v, false,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif
+}
+
+// Relaxed, for statistics counters.
+inline void AtomicIncrement(volatile unsigned int* p) {
+#ifdef _WIN32
+    InterlockedIncrement((volatile LONG*)p);
+#else
+    __atomic_fetch_add(p, 1, __ATOMIC_RELAXED);
+#endif
+}
+
+// Sequentially consistent, for a store of one flag followed by a load
+// of another that must not be reordered.
+inline unsigned int AtomicLoadSeq(volatile unsigned int* p) {
+#ifdef _WIN32
+    return InterlockedCompareExchange((volatile LONG*)p, 0, 0);
+#else
+    return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+#endif
+}
+
+// Returns the value before the addition.
+inline unsigned int AtomicAdd(volatile unsigned int* p, int v) {
+#ifdef _WIN32
+    return InterlockedExchangeAdd((volatile LONG*)p, v);
+#else
+    return __atomic_fetch_add(p, v, __ATOMIC_SEQ_CST);
+#endif
+}
+
+}
+}
+
+#endif // _UTILS_ATOMIC_H_
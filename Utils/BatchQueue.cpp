@@ -0,0 +1,270 @@
+// Batch render queue
+// -------------------------------------------------------------------
+// Copyright (C) 2011 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include "BatchQueue.h"
+
+#include <Core/Thread.h>
+#include <Logging/Logger.h>
+#include <Utils/Timer.h>
+
+#include <FreeImage.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace OpenEngine {
+namespace Utils {
+
+using namespace Math;
+using namespace Renderers;
+using namespace std;
+
+const float BatchQueue::CLUSTER_FAR = 1000.0f;
+
+// Order jobs so that neighbours share framebuffer size and materials.
+static bool StateOrder(const BatchJob& a, const BatchJob& b) {
+    if (a.width != b.width) return a.width < b.width;
+    if (a.height != b.height) return a.height < b.height;
+    if (a.overrides != b.overrides) return a.overrides < b.overrides;
+    if (a.phi != b.phi) return a.phi < b.phi;
+    if (a.theta != b.theta) return a.theta < b.theta;
+    return a.r < b.r;
+}
+
+class BatchQueue::Worker : public Core::Thread {
+private:
+    BatchQueue& queue;
+    SoftwareRenderer::Target target;
+    LightClusters clusters;
+public:
+    Worker(BatchQueue& queue) : queue(queue) {
+        for (unsigned int i = 0; i < queue.lights.size(); ++i)
+            clusters.AddLight(queue.lights[i]);
+    }
+    virtual ~Worker() {}
+
+    void Run() {
+        unsigned int first, last;
+        while (queue.Take(first, last))
+            for (unsigned int i = first; i < last; ++i)
+                queue.RenderJob(queue.jobs[i], target, clusters);
+    }
+};
+
+BatchQueue::BatchQueue(Scene::ISceneNode* scene)
+    : renderer(scene), output("."), next(0) {
+    center[0] = center[1] = center[2] = 0.0f;
+    LightClusters sceneLights;
+    sceneLights.AddLights(scene);
+    for (unsigned int i = 0; i < sceneLights.GetLightCount(); ++i)
+        lights.push_back(sceneLights.GetLight(i));
+}
+
+BatchQueue::~BatchQueue() {}
+
+void BatchQueue::SetCenter(float x, float y, float z) {
+    center[0] = x; center[1] = y; center[2] = z;
+}
+
+bool BatchQueue::Load(const string file) {
+    ifstream in(file.c_str());
+    if (!in) {
+        logger.error << "Batch: could not read job file " << file << logger.end;
+        return false;
+    }
+
+    string line;
+    for (unsigned int n = 1; getline(in, line); ++n) {
+        string::size_type hash = line.find('#');
+        if (hash != string::npos) line.erase(hash);
+        istringstream ls(line);
+        string cmd;
+        if (!(ls >> cmd)) continue;
+
+        if (cmd == "output") {
+            ls >> output;
+            continue;
+        }
+        if (cmd == "light") {
+            LightClusters::Light light;
+            light.quadAtt = 0.0f;
+            light.radius = 0.0f;
+            if (!(ls >> light.position[0] >> light.position[1] >> light.position[2]
+                     >> light.color[0] >> light.color[1] >> light.color[2]
+                     >> light.constAtt >> light.linearAtt)) {
+                logger.warning << file << ":" << n << ": malformed light" << logger.end;
+                continue;
+            }
+            ls >> light.quadAtt;
+            lights.push_back(light);
+            continue;
+        }
+        if (cmd != "job") {
+            logger.warning << file << ":" << n << ": unknown command " << cmd << logger.end;
+            continue;
+        }
+
+        BatchJob job;
+        job.time = 0;
+        job.written = false;
+        if (!(ls >> job.name >> job.width >> job.height >> job.r >> job.theta >> job.phi)
+            || job.width == 0 || job.height == 0) {
+            logger.warning << file << ":" << n << ": malformed job" << logger.end;
+            continue;
+        }
+
+        bool valid = true;
+        string o;
+        while (ls >> o) {
+            string::size_type eq = o.find('=');
+            if (eq == string::npos) { valid = false; break; }
+            vector<float> color;
+            istringstream cs(o.substr(eq + 1));
+            float c;
+            char comma;
+            while (cs >> c) {
+                color.push_back(c);
+                cs >> comma;
+            }
+            if (color.size() < 3) { valid = false; break; }
+            job.overrides[o.substr(0, eq)] = color;
+        }
+        if (!valid) {
+            logger.warning << file << ":" << n << ": malformed material override " << o << logger.end;
+            continue;
+        }
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+bool BatchQueue::Take(unsigned int& first, unsigned int& last) {
+    lock.Lock();
+    first = next;
+    last = next + RUN_LENGTH < jobs.size() ? next + RUN_LENGTH : jobs.size();
+    next = last;
+    lock.Unlock();
+    return first < last;
+}
+
+void BatchQueue::RenderJob(BatchJob& job, SoftwareRenderer::Target& target,
+                           LightClusters& clusters) {
+    Timer timer;
+    timer.Start();
+
+    // same orbit as CamHandler, with the light following the camera
+    SoftwareRenderer::View view;
+    view.width = job.width;
+    view.height = job.height;
+    Vector<3,float> eye = center + Vector<3,float>(job.r * sin(job.theta) * cos(job.phi),
+                                                   job.r * cos(job.theta),
+                                                   job.r * sin(job.theta) * sin(job.phi));
+    view.basis = ViewBasis(eye, center);
+    view.light = eye + Vector<3,float>(10.0f, 50.0f, 0.0f);
+    view.constAtt = .89f;
+    view.linearAtt = 1.0f - 0.99f;
+
+    if (clusters.GetLightCount() > 0) {
+        // jobs already run in parallel, bin on this thread
+        clusters.SetView(view.basis, view.fovy,
+                         float(job.width) / float(job.height),
+                         view.znear, CLUSTER_FAR);
+        clusters.Build(1);
+        view.clusters = &clusters;
+    }
+
+    renderer.Render(view, job.overrides, target);
+
+    FIBITMAP* dib = FreeImage_Allocate(job.width, job.height, 24);
+    for (unsigned int y = 0; y < job.height; ++y) {
+        // FreeImage stores the bottom row first
+        BYTE* line = FreeImage_GetScanLine(dib, job.height - 1 - y);
+        const unsigned char* src = &target.color[y * job.width * 3];
+        for (unsigned int x = 0; x < job.width; ++x, line += 3, src += 3) {
+            line[FI_RGBA_RED]   = src[0];
+            line[FI_RGBA_GREEN] = src[1];
+            line[FI_RGBA_BLUE]  = src[2];
+        }
+    }
+    job.file = job.name + ".png";
+    string path = output + "/" + job.file;
+    // failures are logged by Run(), the logger streams are not thread safe
+    job.written = FreeImage_Save(FIF_PNG, dib, path.c_str(), PNG_DEFAULT) != 0;
+    FreeImage_Unload(dib);
+
+    job.time = timer.GetElapsedIntervals(1000);
+}
+
+unsigned int BatchQueue::Run(unsigned int threads) {
+    if (threads == 0) threads = 1;
+    stable_sort(jobs.begin(), jobs.end(), StateOrder);
+    next = 0;
+
+    logger.info << "Batch: " << jobs.size() << " jobs, "
+                << renderer.GetTriangleCount() << " triangles, "
+                << lights.size() << " point lights, "
+                << threads << " threads" << logger.end;
+
+    Timer timer;
+    timer.Start();
+    vector<Worker*> workers;
+    for (unsigned int i = 0; i < threads; ++i) {
+        workers.push_back(new Worker(*this));
+        workers.back()->Start();
+    }
+    for (unsigned int i = 0; i < threads; ++i) {
+        workers[i]->Wait();
+        delete workers[i];
+    }
+    // in milliseconds, microseconds wrap after 71 minutes of a long run
+    unsigned int elapsed = timer.GetElapsedIntervals(1000);
+
+    unsigned int written = 0;
+    for (unsigned int i = 0; i < jobs.size(); ++i) {
+        if (jobs[i].written) ++written;
+        else logger.warning << "Batch: could not write "
+                            << output << "/" << jobs[i].file << logger.end;
+    }
+
+    WriteManifest(elapsed);
+    logger.info << "Batch: " << written << " images in " << elapsed << " ms, "
+                << (elapsed > 0 ? written * 1e3 / elapsed : 0.0) << " images/s"
+                << logger.end;
+    return written;
+}
+
+void BatchQueue::WriteManifest(unsigned int elapsedMs) {
+    string path = output + "/manifest.csv";
+    ofstream out(path.c_str());
+    if (!out) {
+        logger.warning << "Batch: could not write " << path << logger.end;
+        return;
+    }
+    out << "# " << jobs.size() << " jobs in " << elapsedMs << " ms\n";
+    out << "name,file,width,height,r,theta,phi,overrides,ms\n";
+    for (vector<BatchJob>::const_iterator j = jobs.begin(); j != jobs.end(); ++j) {
+        if (!j->written) continue;
+        out << j->name << "," << j->file << "," << j->width << "," << j->height << ","
+            << j->r << "," << j->theta << "," << j->phi << ",";
+        SoftwareRenderer::MaterialOverrides::const_iterator o = j->overrides.begin();
+        for (; o != j->overrides.end(); ++o) {
+            if (o != j->overrides.begin()) out << ";";
+            out << o->first << "=";
+            for (unsigned int c = 0; c < o->second.size(); ++c)
+                out << (c ? " " : "") << o->second[c];
+        }
+        out << "," << j->time << "\n";
+    }
+}
+
+}
+}
@@ -0,0 +1,111 @@
+// Batch render queue
+// -------------------------------------------------------------------
+// Copyright (C) 2011 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _BATCH_QUEUE_H_
+#define _BATCH_QUEUE_H_
+
+#include <Core/Mutex.h>
+#include "../Renderers/LightClusters.h"
+#include "../Renderers/SoftwareRenderer.h"
+
+#include <string>
+#include <vector>
+
+namespace OpenEngine {
+    namespace Scene {
+        class ISceneNode;
+    }
+namespace Utils {
+
+/**
+ * One image of a configurator run: a camera orbit position in the
+ * same r/theta/phi terms as the interactive CamHandler, a resolution
+ * and a set of material color overrides.
+ */
+struct BatchJob {
+    std::string name;
+    unsigned int width, height;
+    float r, theta, phi;
+    Renderers::SoftwareRenderer::MaterialOverrides overrides;
+
+    // filled in by BatchQueue::Run
+    std::string file;
+    unsigned int time;  // milliseconds
+    bool written;
+};
+
+/**
+ * Renders a job file offscreen with the software renderer.
+ *
+ * The job file is line based, '#' starts a comment:
+ *
+ *   output renders/
+ *   job <name> <width> <height> <r> <theta> <phi> [<material>=<r>,<g>,<b> ...]
+ *   light <x> <y> <z> <r> <g> <b> <constAtt> <linearAtt> [<quadAtt>]
+ *
+ * Lights from the file and the PointLightNodes of the scene are
+ * binned into view space clusters for every job, on top of the light
+ * that follows the camera.
+ *
+ * Jobs are sorted so that consecutive jobs share resolution and
+ * materials, and workers take short runs of consecutive jobs so each
+ * thread reuses its buffers. Every job is written as <name>.png next
+ * to a manifest.csv describing the run.
+ */
+class BatchQueue {
+public:
+    // Consecutive jobs handed to a worker at a time.
+    static const unsigned int RUN_LENGTH = 4;
+
+    // Far plane of the light cluster grid.
+    static const float CLUSTER_FAR;
+
+private:
+    Renderers::SoftwareRenderer renderer;
+    std::vector<BatchJob> jobs;
+    std::vector<Renderers::LightClusters::Light> lights;
+    std::string output;
+    Math::Vector<3,float> center;
+
+    Core::Mutex lock;
+    unsigned int next;
+
+    class Worker;
+    friend class Worker;
+
+    bool Take(unsigned int& first, unsigned int& last);
+    void RenderJob(BatchJob& job, Renderers::SoftwareRenderer::Target& target,
+                   Renderers::LightClusters& clusters);
+    void WriteManifest(unsigned int elapsedMs);
+
+public:
+    BatchQueue(Scene::ISceneNode* scene);
+    virtual ~BatchQueue();
+
+    /**
+     * Parse a job file. Malformed lines are reported and skipped.
+     * Returns false if the file could not be read.
+     */
+    bool Load(const std::string file);
+
+    void SetCenter(float x, float y, float z);
+
+    /**
+     * Render all jobs with the given number of threads and return the
+     * number of images written.
+     */
+    unsigned int Run(unsigned int threads);
+
+    const std::vector<BatchJob>& GetJobs() const { return jobs; }
+};
+
+}
+}
+
+#endif // _BATCH_QUEUE_H_
@@ -0,0 +1,82 @@
+// Frame statistics
+// -------------------------------------------------------------------
+// Copyright (C) 2011 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include "FrameStats.h"
+
+namespace OpenEngine {
+namespace Utils {
+
+    FrameStats::FrameStats() {
+        Clear();
+    }
+
+    void FrameStats::Clear() {
+        frameSum = 0.0;
+        next = size = 0;
+        for (unsigned int p = 0; p < MAX_PHASES; ++p)
+            phaseSum[p] = 0.0;
+    }
+
+    void FrameStats::Push(float frame, const float* phaseTimes, unsigned int count) {
+        if (size == CAPACITY) {
+            // overwrite the oldest sample
+            frameSum -= frames[next];
+            for (unsigned int p = 0; p < MAX_PHASES; ++p)
+                phaseSum[p] -= phases[next][p];
+        }
+        else ++size;
+
+        frames[next] = frame;
+        frameSum += frame;
+        for (unsigned int p = 0; p < MAX_PHASES; ++p) {
+            float t = p < count ? phaseTimes[p] : 0.0f;
+            phases[next][p] = t;
+            phaseSum[p] += t;
+        }
+        next = (next + 1) % CAPACITY;
+    }
+
+    float FrameStats::GetFrame(unsigned int i) const {
+        if (i >= size) return 0.0f;
+        return frames[(next + CAPACITY - size + i) % CAPACITY];
+    }
+
+    float FrameStats::GetPhase(unsigned int i, unsigned int phase) const {
+        if (i >= size || phase >= MAX_PHASES) return 0.0f;
+        return phases[(next + CAPACITY - size + i) % CAPACITY][phase];
+    }
+
+    float FrameStats::GetMin() const {
+        if (size == 0) return 0.0f;
+        float m = frames[0];
+        for (unsigned int i = 1; i < size; ++i)
+            if (frames[i] < m) m = frames[i];
+        return m;
+    }
+
+    float FrameStats::GetMax() const {
+        if (size == 0) return 0.0f;
+        float m = frames[0];
+        for (unsigned int i = 1; i < size; ++i)
+            if (frames[i] > m) m = frames[i];
+        return m;
+    }
+
+    float FrameStats::GetAverage() const {
+        if (size == 0) return 0.0f;
+        return float(frameSum / size);
+    }
+
+    float FrameStats::GetPhaseAverage(unsigned int phase) const {
+        if (size == 0 || phase >= MAX_PHASES) return 0.0f;
+        return float(phaseSum[phase] / size);
+    }
+
+}
+}
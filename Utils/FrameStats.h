@@ -0,0 +1,55 @@
+// Frame statistics
+// -------------------------------------------------------------------
+// Copyright (C) 2011 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _FRAME_STATS_H_
+#define _FRAME_STATS_H_
+
+namespace OpenEngine {
+namespace Utils {
+
+/**
+ * Rolling window of frame times with a per phase breakdown.
+ *
+ * All samples live in fixed size arrays, so pushing a frame never
+ * allocates. Times are in milliseconds.
+ */
+class FrameStats {
+public:
+    static const unsigned int CAPACITY = 128;
+    static const unsigned int MAX_PHASES = 4;
+
+private:
+    float frames[CAPACITY];
+    float phases[CAPACITY][MAX_PHASES];
+    double frameSum;
+    double phaseSum[MAX_PHASES];
+    unsigned int next, size;
+
+public:
+    FrameStats();
+
+    void Clear();
+    void Push(float frame, const float* phaseTimes, unsigned int count);
+
+    unsigned int GetSize() const { return size; }
+
+    // i = 0 is the oldest sample and i = GetSize() - 1 the newest.
+    float GetFrame(unsigned int i) const;
+    float GetPhase(unsigned int i, unsigned int phase) const;
+
+    float GetMin() const;
+    float GetMax() const;
+    float GetAverage() const;
+    float GetPhaseAverage(unsigned int phase) const;
+};
+
+}
+}
+
+#endif // _FRAME_STATS_H_
@@ -0,0 +1,309 @@
+// HUD surface
+// -------------------------------------------------------------------
+// Copyright (C) 2011 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include "HUDSurface.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+namespace OpenEngine {
+namespace Utils {
+
+using namespace Resources;
+using namespace std;
+
+// 3x5 glyphs, drawn at twice the size into a CELL_WIDTH x CELL_HEIGHT cell.
+static const struct { char c; const char* rows[5]; } font[] = {
+    {' ', {"...", "...", "...", "...", "..."}},
+    {'0', {"###", "#.#", "#.#", "#.#", "###"}},
+    {'1', {".#.", "##.", ".#.", ".#.", "###"}},
+    {'2', {"###", "..#", "###", "#..", "###"}},
+    {'3', {"###", "..#", "###", "..#", "###"}},
+    {'4', {"#.#", "#.#", "###", "..#", "..#"}},
+    {'5', {"###", "#..", "###", "..#", "###"}},
+    {'6', {"###", "#..", "###", "#.#", "###"}},
+    {'7', {"###", "..#", "..#", "..#", "..#"}},
+    {'8', {"###", "#.#", "###", "#.#", "###"}},
+    {'9', {"###", "#.#", "###", "..#", "###"}},
+    {'A', {".#.", "#.#", "###", "#.#", "#.#"}},
+    {'B', {"##.", "#.#", "##.", "#.#", "##."}},
+    {'C', {".##", "#..", "#..", "#..", ".##"}},
+    {'D', {"##.", "#.#", "#.#", "#.#", "##."}},
+    {'E', {"###", "#..", "##.", "#..", "###"}},
+    {'F', {"###", "#..", "##.", "#..", "#.."}},
+    {'G', {".##", "#..", "#.#", "#.#", ".##"}},
+    {'H', {"#.#", "#.#", "###", "#.#", "#.#"}},
+    {'I', {"###", ".#.", ".#.", ".#.", "###"}},
+    {'J', {"..#", "..#", "..#", "#.#", ".#."}},
+    {'K', {"#.#", "#.#", "##.", "#.#", "#.#"}},
+    {'L', {"#..", "#..", "#..", "#..", "###"}},
+    {'M', {"#.#", "###", "###", "#.#", "#.#"}},
+    {'N', {"##.", "#.#", "#.#", "#.#", "#.#"}},
+    {'O', {".#.", "#.#", "#.#", "#.#", ".#."}},
+    {'P', {"##.", "#.#", "##.", "#..", "#.."}},
+    {'Q', {".#.", "#.#", "#.#", "##.", ".##"}},
+    {'R', {"##.", "#.#", "##.", "#.#", "#.#"}},
+    {'S', {".##", "#..", ".#.", "..#", "##."}},
+    {'T', {"###", ".#.", ".#.", ".#.", ".#."}},
+    {'U', {"#.#", "#.#", "#.#", "#.#", "###"}},
+    {'V', {"#.#", "#.#", "#.#", "#.#", ".#."}},
+    {'W', {"#.#", "#.#", "###", "###", "#.#"}},
+    {'X', {"#.#", "#.#", ".#.", "#.#", "#.#"}},
+    {'Y', {"#.#", "#.#", ".#.", ".#.", ".#."}},
+    {'Z', {"###", "..#", ".#.", "#..", "###"}},
+    {'.', {"...", "...", "...", "...", ".#."}},
+    {':', {"...", ".#.", "...", ".#.", "..."}},
+    {'-', {"...", "...", "###", "...", "..."}},
+    {'/', {"..#", "..#", ".#.", "#..", "#.."}},
+    {'%', {"#.#", "..#", ".#.", "#..", "#.#"}},
+};
+static const unsigned int FONT_SIZE = sizeof(font) / sizeof(font[0]);
+
+// RGB of each phase in the graph, the remainder of the frame is grey.
+static const unsigned char phaseColors[FrameStats::MAX_PHASES][3] = {
+    {255, 160,  40},
+    { 60, 200,  90},
+    { 80, 140, 255},
+    {220,  80, 220},
+};
+static const unsigned char otherColor[3] = {150, 150, 150};
+
+HUDSurfacePtr HUDSurface::Create() {
+    HUDSurfacePtr ptr(new HUDSurface());
+    ptr->weak_this = ptr;
+    return ptr;
+}
+
+HUDSurface::HUDSurface()
+    : Texture2D<unsigned char>(WIDTH, HEIGHT, 4, new unsigned char[WIDTH * HEIGHT * 4])
+    , phaseCount(0)
+    , currentPhase(-1)
+    , graphRange(40.0f)
+    , graphColumn(0)
+    , textElapsed(0)
+    , textInterval(250000)
+    , dirtyCount(0)
+    , lastUpdateTime(0)
+    , lastDirtyPixels(0) {
+    memset(GetVoidDataPtr(), 0, WIDTH * HEIGHT * 4);
+    memset(cells, ' ', sizeof(cells));
+    for (unsigned int p = 0; p < FrameStats::MAX_PHASES; ++p)
+        phaseTimes[p] = 0.0f;
+    BakeAtlas();
+    phaseTimer.Start();
+    updateTimer.Start();
+}
+
+HUDSurface::~HUDSurface() {}
+
+void HUDSurface::BakeAtlas() {
+    memset(atlas, 0, sizeof(atlas));
+    memset(glyphIndex, 0, sizeof(glyphIndex));
+    for (unsigned int g = 0; g < FONT_SIZE && g < GLYPHS; ++g) {
+        glyphIndex[(unsigned char)font[g].c] = g;
+        for (unsigned int y = 0; y < 5; ++y)
+            for (unsigned int x = 0; x < 3; ++x) {
+                if (font[g].rows[y][x] != '#') continue;
+                // scale by two with a one texel margin
+                atlas[g][1 + y*2    ][1 + x*2    ] = 255;
+                atlas[g][1 + y*2    ][1 + x*2 + 1] = 255;
+                atlas[g][1 + y*2 + 1][1 + x*2    ] = 255;
+                atlas[g][1 + y*2 + 1][1 + x*2 + 1] = 255;
+            }
+    }
+    // lower case shares the upper case glyphs
+    for (unsigned int c = 'a'; c <= 'z'; ++c)
+        glyphIndex[c] = glyphIndex[toupper(c)];
+}
+
+unsigned int HUDSurface::AddPhase(string name) {
+    if (phaseCount == FrameStats::MAX_PHASES)
+        return FrameStats::MAX_PHASES - 1;
+    phaseNames[phaseCount] = name;
+    return phaseCount++;
+}
+
+void HUDSurface::Mark(unsigned int phase) {
+    unsigned int now = phaseTimer.GetElapsedIntervals(1);
+    phaseTimer.Reset();
+    if (currentPhase >= 0)
+        phaseTimes[currentPhase] += now * 1e-3f;
+    currentPhase = phase < phaseCount ? int(phase) : -1;
+}
+
+void HUDSurface::Handle(Core::ProcessEventArg arg) {
+    Update(arg.approx);
+}
+
+void HUDSurface::Update(unsigned int approx) {
+    updateTimer.Reset();
+
+    // close the running phase
+    Mark(FrameStats::MAX_PHASES);
+    stats.Push(approx * 1e-3f, phaseTimes, phaseCount);
+    for (unsigned int p = 0; p < FrameStats::MAX_PHASES; ++p)
+        phaseTimes[p] = 0.0f;
+
+    // draw the newest sample and clear the next column as a cursor
+    DrawGraphColumn(graphColumn, stats.GetSize() - 1);
+    graphColumn = (graphColumn + 1) % WIDTH;
+    ClearGraphColumn(graphColumn);
+
+    textElapsed += approx;
+    if (textElapsed >= textInterval) {
+        textElapsed = 0;
+        UpdateText();
+    }
+
+    NotifyDirty();
+    lastUpdateTime = updateTimer.GetElapsedIntervals(1);
+}
+
+void HUDSurface::UpdateText() {
+    char line[COLUMNS + 1];
+    float avg = stats.GetAverage();
+
+    snprintf(line, sizeof(line), "FPS %6.1f  MS %6.2f",
+             avg > 0.0f ? 1000.0f / avg : 0.0f, avg);
+    SetLine(0, line);
+
+    snprintf(line, sizeof(line), "MIN %6.2f  MAX %6.2f",
+             stats.GetMin(), stats.GetMax());
+    SetLine(1, line);
+
+    for (unsigned int p = 0; p < FrameStats::MAX_PHASES; ++p) {
+        if (p < phaseCount)
+            snprintf(line, sizeof(line), "%-10.10s %6.2f",
+                     phaseNames[p].c_str(), stats.GetPhaseAverage(p));
+        else
+            line[0] = '\0';
+        SetLine(2 + p, line);
+    }
+}
+
+void HUDSurface::SetLine(unsigned int row, const char* text) {
+    bool ended = false;
+    for (unsigned int col = 0; col < COLUMNS; ++col) {
+        if (!ended && text[col] == '\0') ended = true;
+        char c = ended ? ' ' : text[col];
+        if (cells[row][col] == c) continue;
+        cells[row][col] = c;
+        DrawGlyph(row, col, c);
+    }
+}
+
+void HUDSurface::DrawGlyph(unsigned int row, unsigned int col, char c) {
+    const unsigned char (*glyph)[CELL_WIDTH] = atlas[glyphIndex[(unsigned char)c & 0x7F]];
+    unsigned char* data = (unsigned char*)GetVoidDataPtr();
+    unsigned int x0 = col * CELL_WIDTH, y0 = row * CELL_HEIGHT;
+    for (unsigned int y = 0; y < CELL_HEIGHT; ++y) {
+        unsigned char* texel = data + ((y0 + y) * WIDTH + x0) * 4;
+        for (unsigned int x = 0; x < CELL_WIDTH; ++x, texel += 4) {
+            texel[0] = texel[1] = texel[2] = 255;
+            texel[3] = glyph[y][x];
+        }
+    }
+    Dirty(x0, y0, CELL_WIDTH, CELL_HEIGHT);
+}
+
+void HUDSurface::ClearGraphColumn(unsigned int x) {
+    unsigned char* data = (unsigned char*)GetVoidDataPtr();
+    for (unsigned int y = GRAPH_TOP; y < HEIGHT; ++y)
+        memset(data + (y * WIDTH + x) * 4, 0, 4);
+    Dirty(x, GRAPH_TOP, 1, GRAPH_HEIGHT);
+}
+
+void HUDSurface::DrawGraphColumn(unsigned int x, unsigned int sample) {
+    unsigned char* data = (unsigned char*)GetVoidDataPtr();
+    const float scale = GRAPH_HEIGHT / graphRange;
+    const unsigned int target = (unsigned int)(16.667f * scale);
+    unsigned int frame = (unsigned int)(stats.GetFrame(sample) * scale);
+    if (frame > GRAPH_HEIGHT) frame = GRAPH_HEIGHT;
+
+    // stack the phases bottom up, the rest of the frame above them
+    unsigned int bounds[FrameStats::MAX_PHASES];
+    float acc = 0.0f;
+    for (unsigned int p = 0; p < FrameStats::MAX_PHASES; ++p) {
+        acc += stats.GetPhase(sample, p);
+        bounds[p] = (unsigned int)(acc * scale);
+    }
+
+    for (unsigned int h = 0; h < GRAPH_HEIGHT; ++h) {
+        unsigned char* texel = data + ((HEIGHT - 1 - h) * WIDTH + x) * 4;
+        const unsigned char* color = NULL;
+        if (h < frame) {
+            color = otherColor;
+            for (unsigned int p = 0; p < phaseCount; ++p)
+                if (h < bounds[p]) { color = phaseColors[p]; break; }
+        }
+        if (color) {
+            texel[0] = color[0]; texel[1] = color[1]; texel[2] = color[2];
+            texel[3] = 200;
+        }
+        else if (h == target) {
+            // 60 fps reference line
+            texel[0] = texel[1] = texel[2] = 255;
+            texel[3] = 96;
+        }
+        else memset(texel, 0, 4);
+    }
+    Dirty(x, GRAPH_TOP, 1, GRAPH_HEIGHT);
+}
+
+// Area of the bounding rectangle of a and b.
+static unsigned int UnionArea(unsigned int ax, unsigned int ay, unsigned int aw, unsigned int ah,
+                              unsigned int bx, unsigned int by, unsigned int bw, unsigned int bh) {
+    unsigned int x0 = ax < bx ? ax : bx, y0 = ay < by ? ay : by;
+    unsigned int x1 = ax + aw > bx + bw ? ax + aw : bx + bw;
+    unsigned int y1 = ay + ah > by + bh ? ay + ah : by + bh;
+    return (x1 - x0) * (y1 - y0);
+}
+
+void HUDSurface::Dirty(unsigned int x, unsigned int y, unsigned int w, unsigned int h) {
+    // merge into the rectangle that grows the least, but only start a
+    // new one when merging would upload texels nobody touched
+    unsigned int best = MAX_DIRTY, bestWaste = 0;
+    for (unsigned int i = 0; i < dirtyCount; ++i) {
+        const Rect& r = dirty[i];
+        unsigned int area = UnionArea(r.x, r.y, r.w, r.h, x, y, w, h);
+        unsigned int used = r.w * r.h + w * h;
+        unsigned int waste = area > used ? area - used : 0;
+        if (best == MAX_DIRTY || waste < bestWaste) {
+            best = i;
+            bestWaste = waste;
+        }
+    }
+    if (best == MAX_DIRTY || (bestWaste > 0 && dirtyCount < MAX_DIRTY)) {
+        Rect& r = dirty[dirtyCount++];
+        r.x = x; r.y = y; r.w = w; r.h = h;
+        return;
+    }
+    Rect& r = dirty[best];
+    unsigned int x1 = r.x + r.w > x + w ? r.x + r.w : x + w;
+    unsigned int y1 = r.y + r.h > y + h ? r.y + r.h : y + h;
+    if (x < r.x) r.x = x;
+    if (y < r.y) r.y = y;
+    r.w = x1 - r.x;
+    r.h = y1 - r.y;
+}
+
+void HUDSurface::NotifyDirty() {
+    lastDirtyPixels = 0;
+    for (unsigned int i = 0; i < dirtyCount; ++i) {
+        const Rect& r = dirty[i];
+        lastDirtyPixels += r.w * r.h;
+        changedEvent.Notify(Texture2DChangedEventArg(ITexture2DPtr(weak_this),
+                                                     r.x, r.y, r.w, r.h));
+    }
+    dirtyCount = 0;
+}
+
+}
+}
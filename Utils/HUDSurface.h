@@ -0,0 +1,152 @@
+// HUD surface
+// -------------------------------------------------------------------
+// Copyright (C) 2011 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _HUD_SURFACE_H_
+#define _HUD_SURFACE_H_
+
+#include <Core/IModule.h>
+#include <Core/IListener.h>
+#include <Resources/Texture2D.h>
+#include <Utils/Timer.h>
+#include "FrameStats.h"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <string>
+
+namespace OpenEngine {
+namespace Utils {
+
+class HUDSurface;
+typedef boost::shared_ptr<HUDSurface> HUDSurfacePtr;
+
+/**
+ * Frame statistics overlay.
+ *
+ * A drop in replacement for FPSSurface that does not rasterize text
+ * with Cairo. The glyphs are baked into an atlas once at
+ * construction, and each update only blits the text cells that
+ * changed plus a single column of the frame time graph. A changed
+ * event is sent per dirty rectangle so the renderer only re-uploads
+ * those parts of the texture. Touching changes are merged, the graph
+ * cursor and the text are never folded into one large rectangle.
+ *
+ * Phases are timed by calling Mark() at phase boundaries, usually
+ * from HUDPhaseMarker listeners attached to the engine events. The
+ * frame is closed when the surface itself receives the process
+ * event, so it should be attached last.
+ */
+class HUDSurface : public Resources::Texture2D<unsigned char>
+                 , public Core::IListener<Core::ProcessEventArg> {
+public:
+    static const unsigned int WIDTH = 256;
+    static const unsigned int HEIGHT = 128;
+    static const unsigned int CELL_WIDTH = 8;
+    static const unsigned int CELL_HEIGHT = 12;
+    static const unsigned int COLUMNS = WIDTH / CELL_WIDTH;
+    static const unsigned int ROWS = 2 + FrameStats::MAX_PHASES;
+    static const unsigned int GRAPH_TOP = ROWS * CELL_HEIGHT;
+    static const unsigned int GRAPH_HEIGHT = HEIGHT - GRAPH_TOP;
+    static const unsigned int GLYPHS = 48;
+    static const unsigned int MAX_DIRTY = 8;
+
+private:
+    boost::weak_ptr<HUDSurface> weak_this;
+
+    unsigned char atlas[GLYPHS][CELL_HEIGHT][CELL_WIDTH];
+    unsigned char glyphIndex[128];
+    char cells[ROWS][COLUMNS];
+
+    FrameStats stats;
+    std::string phaseNames[FrameStats::MAX_PHASES];
+    float phaseTimes[FrameStats::MAX_PHASES];
+    unsigned int phaseCount;
+    int currentPhase;
+    Timer phaseTimer, updateTimer;
+
+    float graphRange;
+    unsigned int graphColumn;
+    unsigned int textElapsed, textInterval;
+
+    struct Rect { unsigned int x, y, w, h; };
+    Rect dirty[MAX_DIRTY];
+    unsigned int dirtyCount;
+    unsigned int lastUpdateTime, lastDirtyPixels;
+
+    HUDSurface();
+
+    void BakeAtlas();
+    void SetLine(unsigned int row, const char* text);
+    void DrawGlyph(unsigned int row, unsigned int col, char c);
+    void DrawGraphColumn(unsigned int x, unsigned int sample);
+    void ClearGraphColumn(unsigned int x);
+    void UpdateText();
+    void Dirty(unsigned int x, unsigned int y, unsigned int w, unsigned int h);
+    void NotifyDirty();
+
+public:
+    static HUDSurfacePtr Create();
+    virtual ~HUDSurface();
+
+    /**
+     * Add a named phase to the breakdown. Returns the phase id to
+     * pass to Mark(), at most FrameStats::MAX_PHASES phases.
+     */
+    unsigned int AddPhase(std::string name);
+
+    /**
+     * End the current phase, if any, and start timing the given one.
+     */
+    void Mark(unsigned int phase);
+
+    /**
+     * Close the frame and refresh the overlay. approx is the frame
+     * time in microseconds, as in Core::ProcessEventArg.
+     */
+    void Update(unsigned int approx);
+
+    void Handle(Core::ProcessEventArg arg);
+
+    /**
+     * Frame time covered by the full graph height, in milliseconds.
+     */
+    void SetGraphRange(float ms) { graphRange = ms; }
+
+    const FrameStats& GetStats() const { return stats; }
+
+    // CPU time of the last Update() in microseconds.
+    unsigned int GetLastUpdateTime() const { return lastUpdateTime; }
+
+    // Number of texels flagged for upload by the last Update(), summed
+    // over its rectangles.
+    unsigned int GetLastDirtyPixels() const { return lastDirtyPixels; }
+};
+
+/**
+ * Starts a HUDSurface phase when the event it is attached to fires.
+ */
+template <class T>
+class HUDPhaseMarker : public Core::IListener<T> {
+private:
+    HUDSurfacePtr hud;
+    unsigned int phase;
+public:
+    HUDPhaseMarker(HUDSurfacePtr hud, unsigned int phase)
+        : hud(hud), phase(phase) {}
+    virtual ~HUDPhaseMarker() {}
+
+    void Handle(T arg) {
+        hud->Mark(phase);
+    }
+};
+
+}
+}
+
+#endif // _HUD_SURFACE_H_
@@ -52,11 +52,19 @@
 #include <Math/HSLColor.h>
 
 #include <Utils/BetterMoveHandler.h>
-#include <Utils/FPSSurface.h>
-#include <Logging/ColorStreamLogger.h>
+#include <Utils/Timer.h>
 
 #include <Display/InterpolatedViewingVolume.h>
 
+// Project stuff
+#include "Logging/AsyncLogger.h"
+#include "Scene/SceneArena.h"
+#include "Utils/BatchQueue.h"
+#include "Utils/HUDSurface.h"
+#include "Benchmarks.h"
+
+#include <fstream>
+
 using OpenEngine::Renderers2::OpenGL::GLRenderer;
 using OpenEngine::Renderers2::OpenGL::GLContext;
 using OpenEngine::Resources2::OpenGL::FXAAShader;
@@ -351,6 +359,108 @@ public:
     }
 };
           
+// Move a freshly loaded model into its own arena when it only holds
+// node types the arena can copy, otherwise keep the loaded graph and
+// set arena to NULL. The loader still builds the graph on the heap, so
+// -arena makes loading slower by the copy and only unloading faster,
+// see "-bench arena" for both sides.
+static ISceneNode* IntoArena(ISceneNode* node, SceneArena*& arena) {
+    arena = new SceneArena();
+    ISceneNode* copy = arena->Clone(node);
+    if (!copy) {
+        delete arena;
+        arena = NULL;
+        return node;
+    }
+    delete node;
+    return copy;
+}
+
+static ISceneNode* LoadModel(const string file) {
+    try {
+        IModelResourcePtr resource = ResourceManager<IModelResource>::Create(file);
+        resource->Load();
+        ISceneNode* node = resource->GetSceneNode();
+        resource->Unload();
+        if (!node) logger.warning << "File: " << file << " not loaded." << logger.end;
+        return node;
+    }
+    catch (ResourceException e) {
+        logger.warning << "File: " << file << ". " << e.what() << logger.end;
+    }
+    return NULL;
+}
+
+// Keeps the static models given on the command line, F5 swaps them
+// out and loads them again. A model in an arena is torn down with a
+// single Release(), one left on the heap is deleted.
+class AssetHandler : public IListener<KeyboardEventArg> {
+private:
+    struct Asset {
+        string file;
+        ISceneNode* node;
+        SceneArena* arena;
+    };
+    ISceneNode* parent;
+    GLContext* ctx;
+    bool usearena;
+    vector<Asset> assets;
+
+    void Unload(Asset& asset) {
+        parent->RemoveNode(asset.node);
+        // the arena keeps its blocks if the meshes are still referenced
+        if (asset.arena) delete asset.arena;
+        else delete asset.node;
+        asset.node = NULL;
+        asset.arena = NULL;
+    }
+
+public:
+    AssetHandler(ISceneNode* parent, GLContext* ctx, bool usearena)
+        : parent(parent), ctx(ctx), usearena(usearena) {}
+    virtual ~AssetHandler() {}
+
+    void Add(const string file, ISceneNode* node, SceneArena* arena) {
+        Asset asset;
+        asset.file = file;
+        asset.node = node;
+        asset.arena = arena;
+        assets.push_back(asset);
+        parent->AddNode(node);
+    }
+
+    void Reload() {
+        Timer timer;
+        timer.Start();
+        for (unsigned int i = 0; i < assets.size(); ++i)
+            Unload(assets[i]);
+        // the context caches buffers by the freed meshes and textures
+        ctx->ReleaseTextures();
+        ctx->ReleaseVBOs();
+        unsigned int unload = timer.GetElapsedIntervals(1);
+
+        for (unsigned int i = 0; i < assets.size(); ++i) {
+            ISceneNode* node = LoadModel(assets[i].file);
+            if (!node) continue;
+            if (usearena) node = IntoArena(node, assets[i].arena);
+            assets[i].node = node;
+            parent->AddNode(node);
+        }
+        // drop the ones that failed to load
+        vector<Asset> loaded;
+        for (unsigned int i = 0; i < assets.size(); ++i)
+            if (assets[i].node) loaded.push_back(assets[i]);
+        assets = loaded;
+
+        logger.info << "Reloaded " << assets.size() << " models, unload "
+                    << unload << " us, total "
+                    << timer.GetElapsedIntervals(1) / 1000 << " ms." << logger.end;
+    }
+
+    void Handle(KeyboardEventArg arg) {
+        if (arg.type == EVENT_PRESS && arg.sym == KEY_F5) Reload();
+    }
+};
 
 int main(int argc, char** argv) {
     int width = 800;
@@ -358,6 +468,9 @@ int main(int argc, char** argv) {
 
     bool fullscreen = false;
     bool docubemap = true;
+    bool usearena = false;
+    unsigned int threads = 4;
+    string bench, logfile, batchfile;
     vector<string> files;
 
     files.push_back("marmor/marmor.dae");
@@ -376,12 +489,35 @@ int main(int argc, char** argv) {
         else if (strcmp(argv[i],"-nocubemap") == 0) {
             docubemap = false;
         }
+        else if (strcmp(argv[i],"-arena") == 0) {
+            usearena = true;
+        }
+        else if (strcmp(argv[i],"-batch") == 0) {
+            if (i + 1 < argc) batchfile = string(argv[++i]);
+        }
+        else if (strcmp(argv[i],"-threads") == 0) {
+            if (i + 1 < argc) threads = strtol(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i],"-log") == 0) {
+            if (i + 1 < argc) logfile = string(argv[++i]);
+        }
+        else if (strcmp(argv[i],"-bench") == 0) {
+            if (i + 1 < argc) bench = string(argv[++i]);
+        }
         else {
             files.push_back(string(argv[i]));
         }
     }
 
-    Logger::AddLogger(new ColorStreamLogger(&std::cout));
+    // logging is written by a background thread, flushed on exit
+    AsyncLogger* log;
+    if (logfile.empty())
+        log = new AsyncLogger(&std::cout, true);
+    else
+        log = new AsyncLogger(new std::ofstream(logfile.c_str()));
+
+    if (!bench.empty()) return Benchmarks::Run(bench, log);
+    Logger::AddLogger(log);
     
     DirectoryManager::AppendPath("projects/ColladaLoader/data/");
     DirectoryManager::AppendPath("resources/");
@@ -389,11 +525,41 @@ int main(int argc, char** argv) {
     ResourceManager<IModelResource>::AddPlugin(new AssimpPlugin()); 
     ResourceManager<ITextureResource>::AddPlugin(new FreeImagePlugin());
 
+    if (!batchfile.empty()) {
+        // offscreen configurator run, no window or GL context needed
+        TransformationNode* batchRoot = new TransformationNode();
+        files.insert(files.begin(), "AudiR8/AudiR8.dae");
+        for (unsigned int i = 0; i < files.size(); ++i) {
+            ISceneNode* node = LoadModel(files[i]);
+            if (node) batchRoot->AddNode(node);
+        }
+        SearchTool st;
+        list<MeshNode*> meshes = st.DescendantMeshNodes(batchRoot);
+        for (list<MeshNode*>::iterator it = meshes.begin(); it != meshes.end(); ++it) {
+            MaterialPtr mat = (*it)->GetMesh()->GetMaterial();
+            if (mat->GetName() == "Windows") mat->transparency = 0.5;
+        }
+
+        BatchQueue queue(batchRoot);
+        if (!queue.Load(batchfile)) return EXIT_FAILURE;
+        queue.Run(threads);
+        return EXIT_SUCCESS;
+    }
+
     Engine* engine = new Engine();
+
+    // the environment redraws the frame, so everything it does is
+    // timed as rendering and the remaining listeners as update.
+    HUDSurfacePtr hud = HUDSurface::Create();
+    unsigned int renderPhase = hud->AddPhase("render");
+    unsigned int updatePhase = hud->AddPhase("update");
+    engine->ProcessEvent().Attach(*(new HUDPhaseMarker<OpenEngine::Core::ProcessEventArg>(hud, renderPhase)));
+
     //IEnvironment* env = new SDLEnvironment(width,height);
     IEnvironment* env = new GLFWEnvironment(width,height);
     engine->InitializeEvent().Attach(*env);
     engine->ProcessEvent().Attach(*env);
+    engine->ProcessEvent().Attach(*(new HUDPhaseMarker<OpenEngine::Core::ProcessEventArg>(hud, updatePhase)));
     engine->DeinitializeEvent().Attach(*env);    
 
     ShaderResourcePlugin* shaderPlugin = new ShaderResourcePlugin();
@@ -442,9 +608,6 @@ int main(int argc, char** argv) {
     SimpleRenderStateHandler* rsh = new SimpleRenderStateHandler(root);
     keyboard->KeyEvent().Attach(*rsh);
     
-    FPSSurfacePtr fps = FPSSurface::Create();
-    engine->ProcessEvent().Attach(*fps);
-
     RGBAColor bgc(0.5f, 0.5f, 0.5f, 1.0f);
 
     Canvas3D* canvas3D = new Canvas3D(width, height);
@@ -464,7 +627,7 @@ int main(int argc, char** argv) {
     CompositeCanvas* canvas = new CompositeCanvas(width, height);
     canvas->AddCanvas(canvas3D, 0, 0);
     // canvas->AddCanvas(cStereoCanvas, 0, 0);
-    CompositeCanvas::Container& fpsc = canvas->AddCanvas(new Canvas2D(fps), 20, 20);
+    CompositeCanvas::Container& fpsc = canvas->AddCanvas(new Canvas2D(hud), 20, 20);
     fpsc.color = RGBColor(0.0, 0.20, 0.5);
     fpsc.opacity = 0.5;
     r->SetCanvas(fadeCanvas);
@@ -501,6 +664,10 @@ int main(int argc, char** argv) {
 
     SearchTool st;
     vector<Animator*> animators;
+    AssetHandler* assets = new AssetHandler(scale, ctx, usearena);
+    keyboard->KeyEvent().Attach(*assets);
+    // the car lives as long as the program
+    SceneArena* carArena = NULL;
 
     // cubemap setup BEGIN
 
@@ -551,6 +718,7 @@ int main(int argc, char** argv) {
         node = resource->GetSceneNode();
         resource->Unload();
         if (node) {
+            if (usearena) node = IntoArena(node, carArena);
             carRoot->AddNode(node);
         }
         else logger.warning << "File: " << "AudiR8/AudiR8.dae" << " not loaded." << logger.end;
@@ -565,6 +733,8 @@ int main(int argc, char** argv) {
             node = resource->GetSceneNode();
             resource->Unload();
             if (node) {
+                SceneArena* arena = NULL;
+                if (usearena) node = IntoArena(node, arena);
                 list<MeshNode*> meshes = st.DescendantMeshNodes(node);
                 list<MeshNode*>::iterator it = meshes.begin();
                 for (; it != meshes.end(); ++it) {
@@ -581,7 +751,7 @@ int main(int argc, char** argv) {
                     engine->ProcessEvent().Attach(*animator);
                     animator->SetActiveAnimation(0);
                 }
-                else scale->AddNode(node);
+                else assets->Add(files[i], node, arena);
 
             }
             else logger.warning << "File: " << files[i] << " not loaded." << logger.end;
@@ -630,6 +800,9 @@ int main(int argc, char** argv) {
                                           shadowmap);
     keyboard->KeyEvent().Attach(*ch);
 
+    // closes the frame, so it must be the last process listener
+    engine->ProcessEvent().Attach(*hud);
+
     // Start the engine.
     engine->Start();
 